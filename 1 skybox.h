@@ -11,14 +11,23 @@ public:
     unsigned int VAO, VBO;
     unsigned int texture;
 
+    // per-frame uniforms, resolved once
+    struct
+    {
+        UniformHandle<glm::mat4> model;
+        UniformHandle<bool> weather;
+    } uniforms;
+
     Skybox(Camera &cam)
         : camera(cam),
           shader("shaders/skybox.vs", "shaders/skybox.fs")
     {
         shader.use();
         shader.setFloat("fogDensity", skyboxFogFactor);
+        uniforms.model = shader.uniform<glm::mat4>("model");
+        uniforms.weather = shader.uniform<bool>("weather");
 
-        glDepthFunc(GL_LEQUAL); // ensure the skybox fail the depth test wherever there's a different object in front of it (its depth is set to 1.0 in the vertex shader, so we need less or equal depth function)
+        glState.depthFunc(GL_LEQUAL); // ensure the skybox fail the depth test wherever there's a different object in front of it (its depth is set to 1.0 in the vertex shader, so we need less or equal depth function)
 
         // unit cube (1 x 1 x 1)
         float skyboxVertices[] = {
@@ -67,7 +76,7 @@ public:
         // setup buffers
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
-        glBindVertexArray(VAO);
+        glState.bindVertexArray(VAO);
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
@@ -84,7 +93,7 @@ public:
         };
 
         glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+        glState.bindTexture(GL_TEXTURE_CUBE_MAP, texture);
 
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -104,20 +113,25 @@ public:
         }
     }
 
-    void draw(glm::mat4 view, glm::mat4 projection, bool weather)
+    //! Queues the skybox in the sky layer of the main pass (after the opaque geometry, where the depth test leaves only the uncovered pixels).
+    void submit(RenderQueue &queue, bool weather)
+    {
+        queue.submit(MAIN_PASS, SKY_LAYER, shader.shaderProgram, texture, 0.0f, [this, weather]
+                     { draw(weather); });
+    }
+
+    void draw(bool weather)
     {
         shader.use();
         glm::mat4 model = glm::mat4(1.0f);
         model = glm::scale(model, skyboxScaleRatio);                                               // correct skybox, so that the sun is a circle
         model = glm::translate(model, glm::vec3(0.0f, -(camera.Position.y + 1.0f) * 0.03f, 0.0f)); // hard-coded (TODO)
-        shader.setMat4("model", model);
-        shader.setMat4("view", glm::mat4(glm::mat3(view))); // remove translation from the view matrix so the skybox moves with the camera, creating the illusion of an infinitely distant environments
-        shader.setMat4("projection", projection);
-        shader.setBool("weather", weather);
+        uniforms.model.set(model);
+        uniforms.weather.set(weather);
 
-        glBindVertexArray(VAO);
+        glState.bindTexture(0, GL_TEXTURE_CUBE_MAP, texture);
+        glState.bindVertexArray(VAO);
         glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
     }
 };
 
@@ -1,6 +1,9 @@
 #ifndef WATER_H
 #define WATER_H
 
+#include "wave solver.h"
+#include "ocean fft.h"
+
 const float waterLevel = -1.0f;            // world‐space y-axis position of the water surface
 const float waterHorizontalScale = 200.0f; // scaling factor for the x and z axes
 
@@ -12,6 +15,20 @@ float waveAmp = 0.0f;
 const float waveFreq = 2.0f * glm::pi<float>() / 20.0f;
 const float waveSpeed = 1.0f;
 
+bool gpuWaves = true; // evaluate the Gerstner waves in the vertex shader over a static grid (false: rebuild and re-upload the mesh on the CPU every frame)
+
+// FFT ocean (Tessendorf) settings, an alternative to the Gerstner waves
+bool oceanWaves = false;                                     // toggled with key O
+const OceanSpectrum oceanSpectrum = OceanSpectrum::JONSWAP;
+const int oceanResolution = 256;                             // FFT size (texels per side of the displacement texture, power of 2)
+const float oceanPatchSize = 100.0f;                         // world-space size of the ocean patch, tiled over the water surface
+const float oceanWindSpeed = 5.0f;                           // m/s at 10 m above the surface (world units are taken as meters)
+const float oceanWindAngle = 0.5f;                           // wind direction, radians from the x-axis
+const float oceanFetch = 20000.0f;                           // distance over which the wind has blown (JONSWAP), m
+const float oceanChoppiness = 1.0f;                          // scale of the horizontal displacement that sharpens the crests
+const int oceanGridSize = 512;                               // cells per side of the water mesh in ocean mode (the waves are much shorter than GRID cells)
+
+const float reflectionClipDepth = 0.5f; // the reflection shows what is above this depth below the water level (a margin for the wave troughs)
 const float terrainReflectionStrength = 0.9f;
 const float skyboxReflectionStrength = 0.3f;
 
@@ -21,20 +38,35 @@ public:
     Shader shader;
     Camera &camera;
     unsigned int VAO, VBO;
-    unsigned int texture, skyboxTexture, reflectionTexture, depthMapTexture;
-    std::vector<float> vertices;
+    unsigned int gridVAO, gridVBO, gridEBO;
+    unsigned int gridIndexCount;
+    unsigned int oceanVAO, oceanVBO, oceanEBO;
+    unsigned int oceanIndexCount;
+    unsigned int oceanDisplacementTexture, oceanSlopeTexture;
+    unsigned int texture, skyboxTexture, depthMapTexture;
+    WaveSolver waveSolver; // CPU waves (gpuWaves off)
+    OceanFFT ocean;        // FFT ocean (oceanWaves on)
     float waterOffset;
+    unsigned int reflectionTexture = 0;           // frame graph texture of the reflection (its storage may change between frames), set before draw()
+    glm::vec4 reflectionRegion = glm::vec4(1.0f); // part of reflectionTexture in use (see FrameGraph::region), set before draw()
 
-    Water(Camera &cam, unsigned int sky, unsigned int reflection, unsigned int shadow)
+    // per-frame uniforms, resolved once
+    struct
+    {
+        UniformHandle<bool> lighting, weather, gpuWaves, oceanWaves;
+        UniformHandle<float> time, waveAmp, offset;
+        UniformHandle<glm::vec4> reflectionRegion;
+    } uniforms;
+
+    Water(Camera &cam, unsigned int sky, unsigned int shadow, ThreadPool &threads)
         : camera(cam),
           skyboxTexture(sky),
-          reflectionTexture(reflection),
           depthMapTexture(shadow),
           shader("shaders/water.vs", "shaders/water.fs"),
+          waveSolver(GRID, threads),
+          ocean(oceanResolution, oceanPatchSize, oceanSpectrum, oceanWindSpeed, oceanWindAngle, oceanFetch, oceanChoppiness, threads),
           waterOffset(0.0f)
     {
-        vertices.resize(GRID * GRID * 6 * 8);
-
         shader.use();
         glm::mat4 model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(0.0f, -1.0f, 0.0f));
@@ -44,26 +76,43 @@ public:
         shader.setInt("shadowMap", 1);
         shader.setInt("terrainReflectionTexture", 2);
         shader.setInt("skyboxReflectionTexture", 3);
+        shader.setInt("oceanDisplacement", 4);
+        shader.setInt("oceanSlope", 5);
+        shader.setFloat("oceanPatchSize", oceanPatchSize);
         shader.setFloat("terrainReflectionStrength", terrainReflectionStrength);
         shader.setFloat("skyboxReflectionStrength", skyboxReflectionStrength);
         shader.setVec3("skyboxScaleRatio", skyboxScaleRatio);
 
-        shader.setVec3("lightPos", lightPos);
-        shader.setVec3("lightColor", lightColor);
-        shader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
         shader.setFloat("ambientStrength", waterAmbientStrength);
         shader.setFloat("diffuseStrength", waterDiffuseStrength);
         shader.setFloat("specularStrength", waterSpecularStrength);
 
-        shader.setVec4("fogColor", fogColor);
         shader.setFloat("fogStart", waterFogStart);
         shader.setFloat("fogEnd", waterFogEnd);
 
+        shader.setFloat("waveFreq", waveFreq);
+        shader.setFloat("waveSpeed", waveSpeed);
+        shader.setFloat("horizontalScale", waterHorizontalScale);
+
+        uniforms.lighting = shader.uniform<bool>("lighting");
+        uniforms.weather = shader.uniform<bool>("weather");
+        uniforms.gpuWaves = shader.uniform<bool>("gpuWaves");
+        uniforms.oceanWaves = shader.uniform<bool>("oceanWaves");
+        uniforms.time = shader.uniform<float>("time");
+        uniforms.waveAmp = shader.uniform<float>("waveAmp");
+        uniforms.offset = shader.uniform<float>("offset");
+        uniforms.reflectionRegion = shader.uniform<glm::vec4>("reflectionRegion");
+
+        buildGrid(GRID, gridVAO, gridVBO, gridEBO, gridIndexCount);
+        buildGrid(oceanGridSize, oceanVAO, oceanVBO, oceanEBO, oceanIndexCount);
+
+        // CPU waves: same grid and indices, full vertices re-uploaded every frame
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
-        glBindVertexArray(VAO);
+        glState.bindVertexArray(VAO);
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, waveSolver.vertices.size() * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gridEBO);
 
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
         glEnableVertexAttribArray(0);
@@ -71,9 +120,10 @@ public:
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(6 * sizeof(float)));
         glEnableVertexAttribArray(2);
+        glState.bindVertexArray(0);
 
         glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        glState.bindTexture(GL_TEXTURE_2D, texture);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -85,121 +135,151 @@ public:
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
         stbi_image_free(data);
+
+        // ocean patch textures (filled every frame in ocean mode), repeated over the water surface
+        glGenTextures(1, &oceanDisplacementTexture);
+        glState.bindTexture(GL_TEXTURE_2D, oceanDisplacementTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, oceanResolution, oceanResolution, 0, GL_RGBA, GL_FLOAT, NULL);
+
+        glGenTextures(1, &oceanSlopeTexture);
+        glState.bindTexture(GL_TEXTURE_2D, oceanSlopeTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, oceanResolution, oceanResolution, 0, GL_RG, GL_FLOAT, NULL);
+        glGenerateMipmap(GL_TEXTURE_2D);
     }
 
-    void draw(glm::mat4 view, glm::mat4 projection, float time, float dt, glm::mat4 reflected_view, bool weather, bool lighting)
+    //! Queues the water as opaque geometry of the main pass, at the distance of the camera from the water surface.
+    void submit(RenderQueue &queue, float time, float dt, bool weather, bool lighting)
     {
-        //! Lambda function to compute vertex position in a 2-directional Gerstner wave.
-        auto computePosition = [&](float x, float z)
-        {
-            // start from original static position
-            glm::vec3 pos{x, 0.0f, z};
-
-            // x-direction wave (Gerstner wave formula)
-            float xPhase = waveFreq * (x * waterHorizontalScale) - waveSpeed * time;
-            pos.x += (waveAmp / waterHorizontalScale) * cos(xPhase); // horizontal displacement
-            pos.y += waveAmp * sin(xPhase);                          // vertical displacement
+        float depth = boxDistance(camera.Position, glm::vec3(-waterHorizontalScale, waterLevel, -waterHorizontalScale), glm::vec3(waterHorizontalScale, waterLevel, waterHorizontalScale));
+        queue.submit(MAIN_PASS, OPAQUE_LAYER, shader.shaderProgram, texture, depth, [this, time, dt, weather, lighting]
+                     { draw(time, dt, weather, lighting); });
+    }
 
-            // z-direction wave
-            float zPhase = waveFreq * (z * waterHorizontalScale) - waveSpeed * time;
-            pos.z += (waveAmp / waterHorizontalScale) * cos(zPhase);
-            pos.y += waveAmp * sin(zPhase);
+    void draw(float time, float dt, bool weather, bool lighting)
+    {
+        if (oceanWaves)
+            updateOcean(time);
+        else if (!gpuWaves)
+            updateMesh(time);
 
-            return pos;
-        };
+        shader.use();
+        uniforms.lighting.set(lighting);
+        uniforms.weather.set(weather);
 
-        //! Lambda function to compute vertex normal.
-        auto computeNormal = [&](float x, float z)
-        {
-            // main neighbor vertices
-            glm::vec3 v10 = computePosition(x, z - worldStep);
-            glm::vec3 v12 = computePosition(x, z + worldStep);
-            glm::vec3 v21 = computePosition(x - worldStep, z);
-            glm::vec3 v01 = computePosition(x + worldStep, z);
+        // in GPU mode these are the only per-frame inputs of the water mesh (no vertex data is uploaded)
+        uniforms.gpuWaves.set(gpuWaves);
+        uniforms.oceanWaves.set(oceanWaves);
+        uniforms.time.set(time);
+        uniforms.waveAmp.set(waveAmp);
 
-            // central difference derivatives (∂y/∂x, ∂y/∂z: f'(x) ≈ (f(x + h) - f(x - h)) / (2h))
-            glm::vec3 dvdx = (v01 - v21) / (2.0f * worldStep);
-            glm::vec3 dvdz = (v12 - v10) / (2.0f * worldStep);
+        waterOffset += waterSpeed * dt;
+        uniforms.offset.set(waterOffset);
+        uniforms.reflectionRegion.set(reflectionRegion);
 
-            return glm::normalize(glm::cross(dvdz, dvdx));
-        };
+        glState.bindTexture(0, GL_TEXTURE_2D, texture);
+        glState.bindTexture(1, GL_TEXTURE_2D_ARRAY, depthMapTexture);
+        glState.bindTexture(2, GL_TEXTURE_2D, reflectionTexture);
+        glState.bindTexture(3, GL_TEXTURE_CUBE_MAP, skyboxTexture);
 
-        //! Lambda function to pack one vertex.
-        auto pack = [&](int idx, glm::vec3 pos, glm::vec3 n, float u, float v)
+        if (oceanWaves)
         {
-            vertices[idx + 0] = pos.x;
-            vertices[idx + 1] = pos.y;
-            vertices[idx + 2] = pos.z;
-            vertices[idx + 3] = n.x;
-            vertices[idx + 4] = n.y;
-            vertices[idx + 5] = n.z;
-            vertices[idx + 6] = u;
-            vertices[idx + 7] = v;
-        };
-
-        // 3D waves mesh generations
-        for (int i = 0; i < GRID; ++i)
+            glState.bindTexture(4, GL_TEXTURE_2D, oceanDisplacementTexture);
+            glState.bindTexture(5, GL_TEXTURE_2D, oceanSlopeTexture);
+
+            glState.bindVertexArray(oceanVAO);
+            glDrawElements(GL_TRIANGLES, oceanIndexCount, GL_UNSIGNED_INT, 0);
+        }
+        else
         {
-            // convert indices to range from grid range [0, GRID - 1] to normalized coordinate range [-1, 1]
-            float z0 = -1.0f + i * worldStep;
-            float z1 = z0 + worldStep;
+            glState.bindVertexArray(gpuWaves ? gridVAO : VAO);
+            glDrawElements(GL_TRIANGLES, gridIndexCount, GL_UNSIGNED_INT, 0);
+        }
+    }
+
+private:
+    //! Uploads a flat size x size cell grid over the water once: (size + 1)^2 shared vertices (position + texture coordinates) indexed as 2 triangles per cell. The vertex shader displaces it every frame.
+    void buildGrid(int size, unsigned int &vao, unsigned int &vbo, unsigned int &ebo, unsigned int &indexCount)
+    {
+        std::vector<float> gridVertices;
+        std::vector<unsigned int> gridIndices;
+        gridVertices.reserve((size + 1) * (size + 1) * 5);
+        gridIndices.reserve(size * size * 6);
 
-            for (int j = 0; j < GRID; ++j)
+        float step = 2.0f / size;
+        float texCoordStep = (float)GRID / size; // the water texture tiles GRID times across the surface whatever the grid size
+
+        for (int i = 0; i <= size; ++i)
+            for (int j = 0; j <= size; ++j)
             {
-                float x0 = -1.0f + j * worldStep;
-                float x1 = x0 + worldStep;
-
-                glm::vec3 v00 = computePosition(x0, z0);
-                glm::vec3 v10 = computePosition(x1, z0);
-                glm::vec3 v11 = computePosition(x1, z1);
-                glm::vec3 v01 = computePosition(x0, z1);
-
-                glm::vec3 n00 = computeNormal(x0, z0);
-                glm::vec3 n10 = computeNormal(x1, z0);
-                glm::vec3 n11 = computeNormal(x1, z1);
-                glm::vec3 n01 = computeNormal(x0, z1);
-
-                // base vertex offset index in the 1D array
-                int base = (i * GRID + j) * 6 * 8;
-
-                // triangle 1: (00, 10, 11)
-                pack(base + 0 * 8, v00, n00, 0.0f, 0.0f);
-                pack(base + 1 * 8, v10, n10, 1.0f, 0.0f);
-                pack(base + 2 * 8, v11, n11, 1.0f, 1.0f);
-
-                // triangle 2: (00, 11, 01)
-                pack(base + 3 * 8, v00, n00, 0.0f, 0.0f);
-                pack(base + 4 * 8, v11, n11, 1.0f, 1.0f);
-                pack(base + 5 * 8, v01, n01, 0.0f, 1.0f);
+                gridVertices.push_back(-1.0f + j * step);
+                gridVertices.push_back(0.0f);
+                gridVertices.push_back(-1.0f + i * step);
+
+                // for the GRID grid: integer texture coordinates + GL_REPEAT tile the water texture once per cell (same as WaveSolver)
+                gridVertices.push_back(j * texCoordStep);
+                gridVertices.push_back(i * texCoordStep);
             }
-        }
 
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(float), vertices.data());
+        for (int i = 0; i < size; ++i)
+            for (int j = 0; j < size; ++j)
+            {
+                unsigned int v00 = i * (size + 1) + j;
+                unsigned int v10 = v00 + 1;
+                unsigned int v01 = v00 + (size + 1);
+                unsigned int v11 = v01 + 1;
 
-        shader.use();
-        shader.setMat4("view", view);
-        shader.setMat4("projection", projection);
-        shader.setMat4("reflected_view", reflected_view);
-        shader.setBool("lighting", lighting);
-        shader.setBool("weather", weather);
-        shader.setVec3("cameraPos", camera.Position);
+                // (00, 10, 11) and (00, 11, 01)
+                gridIndices.insert(gridIndices.end(), {v00, v10, v11, v00, v11, v01});
+            }
 
-        waterOffset += waterSpeed * dt;
-        shader.setFloat("offset", waterOffset);
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, reflectionTexture);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
-
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, vertices.size() / 8);
-        glBindVertexArray(0);
+        indexCount = gridIndices.size();
+
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ebo);
+        glState.bindVertexArray(vao);
+
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, gridVertices.size() * sizeof(float), gridVertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, gridIndices.size() * sizeof(unsigned int), gridIndices.data(), GL_STATIC_DRAW);
+
+        // attribute 1 (normal) stays disabled, the shader computes it
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(3 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+
+        glState.bindVertexArray(0);
+    }
+
+    //! FFT ocean: evaluates the patch and uploads it into the displacement and slope textures.
+    void updateOcean(float time)
+    {
+        ocean.update(time);
+
+        glState.bindTexture(GL_TEXTURE_2D, oceanDisplacementTexture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, oceanResolution, oceanResolution, GL_RGBA, GL_FLOAT, ocean.displacement.data());
+        glState.bindTexture(GL_TEXTURE_2D, oceanSlopeTexture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, oceanResolution, oceanResolution, GL_RG, GL_FLOAT, ocean.slope.data());
+        glGenerateMipmap(GL_TEXTURE_2D); // slopes are sampled per fragment, also far away
+    }
+
+    //! CPU path: evaluates the waves on the grid vertices and re-uploads them.
+    void updateMesh(float time)
+    {
+        waveSolver.update(time, waveAmp, waveFreq, waveSpeed, waterHorizontalScale);
+
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, waveSolver.vertices.size() * sizeof(float), waveSolver.vertices.data());
     }
 };
 
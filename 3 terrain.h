@@ -1,45 +1,242 @@
 #ifndef TERRAIN_H
 #define TERRAIN_H
 
+#include <cfloat>
+#include <memory>
+
+bool useTerrainLOD = false; // render the terrain with continuous level of detail instead of the full-resolution mesh
+
 const float terrainOffset = waterLevel - 1.4f;    // world‐space y-axis position of the terrain
 const float terrainHorizontalScale = 0.05f;       // scaling factor for the x and z axes
 const float terrainVerticalScale = 5.0f / 255.0f; // scaling factor for the y-axis + pixel value conversion
 const float detailLevel = 50.0f;                  // frequency of the detail texture, controlling how much detail is applied to the surface
+const unsigned int restartIndex = 0xFFFFFFFF;     // index value that terminates the current triangle strip and starts a new one
+const int terrainChunkSize = 32;                  // number of quads along each side of a terrain chunk (the unit of frustum culling)
+
+// a square piece of the terrain mesh: a range in the index buffer + its world-space bounding box
+struct TerrainChunk
+{
+    glm::vec3 boxMin, boxMax;
+    unsigned int firstIndex, indexCount;
+};
+
+#include "terrain tiles.h" // out-of-core height map tiles
+#include "terrain lod.h"   // continuous level of detail renderer (uses the terrain settings above)
 
 class Terrain
 {
 public:
-    Shader shader;
+    Shader shader, lodShader;             // main and reflection passes: full-resolution chunked mesh / CDLOD patches
+    Shader shadowShader, lodShadowShader; // shadow pass
     Camera &camera;
-    unsigned int VAO, VBO;
+    unsigned int VAO, VBO, EBO;
     unsigned int mainTexture, detailTexture, skyboxTexture, depthMapTexture;
     std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<TerrainChunk> chunks;
+    std::vector<GLsizei> drawCounts;       // per-draw index counts of the visible chunks (reused every pass to avoid allocations)
+    std::vector<const void *> drawOffsets; // per-draw byte offsets of the visible chunks into the index buffer
+    int visibleChunks = 0;                 // number of chunks that passed the frustum test in the last drawGeometry() call
+    std::unique_ptr<TileStreamer> streamer; // height map tile streamer (streaming mode only)
+    std::unique_ptr<TerrainLOD> lod;       // continuous level of detail renderer (height map sampled in the vertex shader)
+
+    // per-frame uniforms of the terrain programs (shader, lodShader, lodShadowShader), resolved once
+    struct PassUniforms
+    {
+        UniformHandle<bool> lighting;
+        UniformHandle<float> gridDim; // LOD only
+    } meshUniforms, lodUniforms, lodShadowUniforms;
 
     Terrain(Camera &cam, unsigned int sky, unsigned int shadow)
         : camera(cam),
           skyboxTexture(sky),
           depthMapTexture(shadow),
-          shader("shaders/terrain.vs", "shaders/terrain.fs")
+          shader("shaders/terrain.vs", "shaders/terrain.fs"),
+          lodShader("shaders/terrain lod.vs", "shaders/terrain.fs"),
+          shadowShader("shaders/shadow.vs", "shaders/shadow.fs"),
+          lodShadowShader("shaders/terrain lod.vs", "shaders/shadow.fs")
+    {
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, terrainOffset, 0.0f));
+
+        for (Shader *s : {&shader, &lodShader})
+        {
+            s->use();
+            s->setMat4("model", model);
+            s->setFloat("detailLevel", detailLevel);
+            s->setInt("mainTexture", 0);
+            s->setInt("detailTexture", 1);
+            s->setInt("shadowMap", 2);
+            s->setInt("skyboxReflectionTexture", 3);
+            s->setVec3("skyboxScaleRatio", skyboxScaleRatio);
+
+            s->setFloat("ambientStrength", terrainAmbientStrength);
+            s->setFloat("diffuseStrength", terrainDiffuseStrength);
+        }
+
+        for (auto pass : {std::make_pair(&shader, &meshUniforms), std::make_pair(&lodShader, &lodUniforms), std::make_pair(&lodShadowShader, &lodShadowUniforms)})
+        {
+            pass.second->lighting = pass.first->uniform<bool>("lighting");
+            pass.second->gridDim = pass.first->uniform<float>("gridDim");
+        }
+
+        shadowShader.use();
+        shadowShader.setMat4("model", model);
+
+        // the LOD shadow pass reuses the LOD vertex shader with the light as the camera (LIGHT_CAMERA + cascade: lightView and the projection of the cascade)
+        lodShadowShader.use();
+        lodShadowShader.setMat4("model", model);
+
+        // streaming mode: the height map is paged in tile by tile around the camera (the tile file is generated from the height map image on first use, and again when the image or the tile size changes), only the LOD renderer is available
+        if (streamTerrain)
+        {
+            if (tileFileUpToDate("data/heightmap.bmp", terrainTilesPath, terrainTileSize) || buildTileFile("data/heightmap.bmp", terrainTilesPath, terrainTileSize))
+                streamer.reset(new TileStreamer(terrainTilesPath, tileBudgetMB << 20));
+
+            if (streamer && streamer->valid)
+            {
+                lod.reset(new TerrainLOD(*streamer));
+                std::cout << "Terrain streaming: " << streamer->header.width << "x" << streamer->header.height << " texels, "
+                          << streamer->header.tilesX * streamer->header.tilesZ << " tiles, " << tileBudgetMB << " MB budget" << std::endl;
+            }
+            else
+            {
+                std::cout << "Terrain streaming: cannot open " << terrainTilesPath << ", loading the whole height map" << std::endl;
+                streamer.reset();
+            }
+        }
+
+        int width, height, nrChannels;
+        unsigned char *data;
+
+        if (!streamer)
+        {
+            int x_size, z_size;
+            data = stbi_load("data/heightmap.bmp", &x_size, &z_size, &nrChannels, STBI_grey);
+
+            lod.reset(new TerrainLOD(data, x_size, z_size));
+            buildMesh(data, x_size, z_size);
+            stbi_image_free(data);
+        }
+
+        lod->setupShader(lodShader);
+        lod->setupShader(lodShadowShader);
+
+        glEnable(GL_PRIMITIVE_RESTART); // allow a single draw call to contain several triangle strips (both renderers)
+        glPrimitiveRestartIndex(restartIndex);
+
+        glGenTextures(1, &mainTexture);
+        glState.bindTexture(GL_TEXTURE_2D, mainTexture);
+        data = stbi_load("data/terrain.bmp", &width, &height, &nrChannels, 0);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        stbi_image_free(data);
+
+        glGenTextures(1, &detailTexture);
+        glState.bindTexture(GL_TEXTURE_2D, detailTexture);
+        data = stbi_load("data/detail.bmp", &width, &height, &nrChannels, 0);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        stbi_image_free(data);
+    }
+
+    //! Per-frame update: streams height map tiles around the camera.
+    void update()
+    {
+        if (streamer)
+            streamer->update(camera.Position.x / terrainHorizontalScale, camera.Position.z / terrainHorizontalScale);
+    }
+
+    //! Returns true if the terrain is rendered with the LOD renderer (the full-resolution mesh does not exist in streaming mode).
+    bool lodActive()
     {
-        shader.use();
-        shader.setMat4("model", glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, terrainOffset, 0.0f)));
-        shader.setFloat("clipPlane", terrainOffset + 0.9f);
-        shader.setFloat("detailLevel", detailLevel);
-        shader.setInt("mainTexture", 0);
-        shader.setInt("detailTexture", 1);
-        shader.setInt("shadowMap", 2);
-        shader.setInt("skyboxReflectionTexture", 3);
-        shader.setVec3("skyboxScaleRatio", skyboxScaleRatio);
-
-        shader.setVec3("lightPos", lightPos);
-        shader.setVec3("lightColor", lightColor);
-        shader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-        shader.setFloat("ambientStrength", terrainAmbientStrength);
-        shader.setFloat("diffuseStrength", terrainDiffuseStrength);
-
-        int x_size, z_size, width, height, nrChannels;
-        unsigned char *data = stbi_load("data/heightmap.bmp", &x_size, &z_size, &nrChannels, STBI_grey);
+        return useTerrainLOD || streamer;
+    }
 
+    //! Queues the terrain as opaque geometry of the given pass (main or reflection), at the distance of the pass camera from the terrain's bounding box.
+    void submit(RenderQueue &queue, RenderPass pass, const glm::mat4 &view, const glm::mat4 &projection, bool lighting)
+    {
+        glm::vec3 eye = glm::vec3(glm::inverse(view)[3]), boxMin, boxMax;
+        lod->bounds(boxMin, boxMax);
+        queue.submit(pass, OPAQUE_LAYER, (lodActive() ? lodShader : shader).shaderProgram, mainTexture, boxDistance(eye, boxMin, boxMax), [this, view, projection, lighting]
+                     { draw(view, projection, lighting); });
+    }
+
+    //! Renders the terrain from the given camera (used by the main and reflection passes).
+    void draw(glm::mat4 view, glm::mat4 projection, bool lighting)
+    {
+        Shader &active = lodActive() ? lodShader : shader;
+        PassUniforms &uniforms = lodActive() ? lodUniforms : meshUniforms;
+        active.use();
+        uniforms.lighting.set(lighting);
+
+        glState.bindTexture(0, GL_TEXTURE_2D, mainTexture);
+        glState.bindTexture(1, GL_TEXTURE_2D, detailTexture);
+        glState.bindTexture(2, GL_TEXTURE_2D_ARRAY, depthMapTexture);
+        glState.bindTexture(3, GL_TEXTURE_CUBE_MAP, skyboxTexture);
+
+        if (lodActive())
+        {
+            glm::vec3 eye = glm::vec3(glm::inverse(view)[3]); // pass camera position (same as in the Camera block the LOD morph uses)
+            lod->select(Frustum(projection * view), eye);
+            lod->drawGeometry(uniforms.gridDim);
+        }
+        else
+            drawGeometry(projection * view);
+    }
+
+    //! State that the shadow pass output depends on (the full-resolution mesh never changes, the LOD geometry follows the camera and the streamed tiles).
+    TerrainShadowState shadowState()
+    {
+        if (!lodActive())
+            return {false, glm::vec3(0.0f), 0};
+        return {true, camera.Position, streamer ? streamer->uploadedTiles : 0};
+    }
+
+    //! Renders the terrain depth from the light's perspective into the currently bound shadow map (cascade); lightSpace is the view-projection of the cascade, for culling.
+    void drawShadow(const glm::mat4 &lightSpace)
+    {
+        if (lodActive())
+        {
+            lodShadowShader.use();
+            lod->select(Frustum(lightSpace), camera.Position); // LOD still follows the camera (position of the LIGHT_CAMERA block), so that shadows match the geometry seen on screen
+            lod->drawGeometry(lodShadowUniforms.gridDim);
+        }
+        else
+        {
+            shadowShader.use();
+            drawGeometry(lightSpace);
+        }
+    }
+
+    //! Issues the terrain draw call with whatever shader is currently bound (shared by the main, reflection and shadow passes); only the chunks inside the frustum of the given view-projection matrix are submitted.
+    void drawGeometry(const glm::mat4 &viewProjection)
+    {
+        Frustum frustum(viewProjection);
+
+        drawCounts.clear();
+        drawOffsets.clear();
+
+        for (const TerrainChunk &chunk : chunks)
+        {
+            if (frustum.intersectsBox(chunk.boxMin, chunk.boxMax))
+            {
+                drawCounts.push_back(chunk.indexCount);
+                drawOffsets.push_back((void *)(chunk.firstIndex * sizeof(unsigned int)));
+            }
+        }
+
+        visibleChunks = drawCounts.size();
+        if (visibleChunks == 0)
+            return;
+
+        glState.bindVertexArray(VAO);
+        glMultiDrawElements(GL_TRIANGLE_STRIP, drawCounts.data(), GL_UNSIGNED_INT, drawOffsets.data(), visibleChunks); // all visible chunks in a single call
+    }
+
+private:
+    //! Builds the full-resolution chunked mesh from an 8-bit height map (x_size rows along the z-axis, z_size texels per row).
+    void buildMesh(const unsigned char *data, int x_size, int z_size)
+    {
         //! Lambda function to pack one vertex.
         auto pack = [&](float x, float y, float z, float u, float v)
         {
@@ -50,80 +247,86 @@ public:
             vertices.push_back(v);
         };
 
-        // terrain mesh generation from the height map (structured as triangles, which is optimal for rendering terrain surface: each quad → 2 triangles → 6 vertices)
-        // simplified formula without scaling: vertex[i, j] = (x, y, z) = (i, heightmap[i, j], j)
-        for (int i = 0; i < x_size - 1; ++i)
+        // terrain mesh generation from the height map (one shared vertex per height map texel, so that each vertex is transformed once and reused by up to 6 triangles from the post-transform cache)
+        // simplified formula without scaling: vertex[i, j] = (x, y, z) = (j, heightmap[i, j], i)
+        vertices.reserve(x_size * z_size * 5);
+        for (int i = 0; i < x_size; ++i)
         {
-            for (int j = 0; j < z_size - 1; ++j)
+            for (int j = 0; j < z_size; ++j)
             {
-                float y00 = data[i * z_size + j] * terrainVerticalScale;
-                float y10 = data[i * z_size + (j + 1)] * terrainVerticalScale;
-                float y11 = data[(i + 1) * z_size + (j + 1)] * terrainVerticalScale;
-                float y01 = data[(i + 1) * z_size + j] * terrainVerticalScale;
-
-                float u0 = j / (float)(z_size - 1);
-                float v0 = i / (float)(x_size - 1);
-                float u1 = (j + 1) / (float)(z_size - 1);
-                float v1 = (i + 1) / (float)(x_size - 1);
-
-                // triangle 1: (00, 10, 11)
-                pack(j * terrainHorizontalScale, y00, i * terrainHorizontalScale, u0, v0);
-                pack((j + 1) * terrainHorizontalScale, y10, i * terrainHorizontalScale, u1, v0);
-                pack((j + 1) * terrainHorizontalScale, y11, (i + 1) * terrainHorizontalScale, u1, v1);
-
-                // triangle 2: (00, 11, 01)
-                pack(j * terrainHorizontalScale, y00, i * terrainHorizontalScale, u0, v0);
-                pack((j + 1) * terrainHorizontalScale, y11, (i + 1) * terrainHorizontalScale, u1, v1);
-                pack(j * terrainHorizontalScale, y01, (i + 1) * terrainHorizontalScale, u0, v1);
+                float y = data[i * z_size + j] * terrainVerticalScale;
+                float u = j / (float)(z_size - 1);
+                float v = i / (float)(x_size - 1);
+
+                pack(j * terrainHorizontalScale, y, i * terrainHorizontalScale, u, v);
             }
         }
 
-        stbi_image_free(data);
+        // index generation: the mesh is split into square chunks of terrainChunkSize quads, each chunk is a contiguous range of the index buffer with a precomputed bounding box for frustum culling
+        // inside a chunk: one triangle strip per row of quads, separated by a primitive restart index
+        // (vertices alternate between rows i + 1 and i, so that each quad is split along the same (00, 11) diagonal: triangles (01, 00, 11) and (00, 11, 10))
+        for (int ci = 0; ci < x_size - 1; ci += terrainChunkSize)
+        {
+            for (int cj = 0; cj < z_size - 1; cj += terrainChunkSize)
+            {
+                int iEnd = std::min(ci + terrainChunkSize, x_size - 1);
+                int jEnd = std::min(cj + terrainChunkSize, z_size - 1);
+
+                TerrainChunk chunk;
+                chunk.firstIndex = indices.size();
+                chunk.boxMin = glm::vec3(cj * terrainHorizontalScale, FLT_MAX, ci * terrainHorizontalScale);
+                chunk.boxMax = glm::vec3(jEnd * terrainHorizontalScale, -FLT_MAX, iEnd * terrainHorizontalScale);
+
+                for (int i = ci; i < iEnd; ++i)
+                {
+                    for (int j = cj; j <= jEnd; ++j)
+                    {
+                        indices.push_back((i + 1) * z_size + j);
+                        indices.push_back(i * z_size + j);
+                    }
+
+                    indices.push_back(restartIndex);
+                }
+
+                // vertical extent of the chunk (in world space, including the terrain offset)
+                for (int i = ci; i <= iEnd; ++i)
+                {
+                    for (int j = cj; j <= jEnd; ++j)
+                    {
+                        float y = vertices[(i * z_size + j) * 5 + 1] + terrainOffset;
+                        chunk.boxMin.y = std::min(chunk.boxMin.y, y);
+                        chunk.boxMax.y = std::max(chunk.boxMax.y, y);
+                    }
+                }
+
+                chunk.indexCount = indices.size() - chunk.firstIndex;
+                chunks.push_back(chunk);
+            }
+        }
+
+        drawCounts.reserve(chunks.size());
+        drawOffsets.reserve(chunks.size());
 
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
-        glBindVertexArray(VAO);
+        glGenBuffers(1, &EBO);
+        glState.bindVertexArray(VAO);
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO); // element buffer binding is stored in the VAO
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)0);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(3 * sizeof(float)));
         glEnableVertexAttribArray(2);
+        glState.bindVertexArray(0);
 
-        glGenTextures(1, &mainTexture);
-        glBindTexture(GL_TEXTURE_2D, mainTexture);
-        data = stbi_load("data/terrain.bmp", &width, &height, &nrChannels, 0);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        stbi_image_free(data);
-
-        glGenTextures(1, &detailTexture);
-        glBindTexture(GL_TEXTURE_2D, detailTexture);
-        data = stbi_load("data/detail.bmp", &width, &height, &nrChannels, 0);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        stbi_image_free(data);
-    }
-
-    void draw(glm::mat4 view, glm::mat4 projection, bool lighting)
-    {
-        shader.use();
-        shader.setMat4("view", view);
-        shader.setMat4("projection", projection);
-        shader.setBool("lighting", lighting);
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, mainTexture);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, detailTexture);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
-
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, vertices.size() / 5);
-        glBindVertexArray(0);
+        // report mesh size compared to the previous layout (6 unindexed vertices per quad)
+        size_t quads = (size_t)(x_size - 1) * (z_size - 1);
+        size_t unindexedBytes = quads * 6 * 5 * sizeof(float);
+        size_t indexedBytes = vertices.size() * sizeof(float) + indices.size() * sizeof(unsigned int);
+        std::cout << "Terrain mesh: " << vertices.size() / 5 << " vertices, " << indices.size() << " indices, " << indexedBytes / 1024 << " KB"
+                  << " (unindexed: " << quads * 6 << " vertices, " << unindexedBytes / 1024 << " KB), " << chunks.size() << " chunks" << std::endl;
     }
 };
 
@@ -0,0 +1,90 @@
+// Throughput of the FFT ocean: complete OceanFFT::update (spectrum at t + 3 complex 2D inverse FFTs + packing) and the 2D FFT alone, single-threaded and on the thread pool.
+// Build from the repository root: g++ -O2 -march=native -pthread bench/ocean.cpp -o bench_ocean
+// Usage: ./bench_ocean [sizes...]   (default: 256 512)
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../ocean fft.h"
+
+//! Average milliseconds per call, repeated for at least ~0.5 s.
+template <typename F>
+double timeIt(F call)
+{
+    using clock = std::chrono::steady_clock;
+    int calls = 0;
+    auto start = clock::now();
+
+    do
+    {
+        call(calls);
+        calls++;
+    } while (std::chrono::duration<double>(clock::now() - start).count() < 0.5);
+
+    return std::chrono::duration<double, std::milli>(clock::now() - start).count() / calls;
+}
+
+//! Max error of inverseFFT2D against a direct 2D DFT (in double precision) on random input.
+double checkFFT(int n, ThreadPool &pool)
+{
+    std::vector<complexf> input(n * n), output;
+    std::mt19937 generator(7);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    for (complexf &c : input)
+        c = complexf(uniform(generator), uniform(generator));
+
+    output = input;
+    FFTPlan plan(n);
+    inverseFFT2D(plan, {output.data()}, pool);
+
+    double maxError = 0.0;
+    for (int z = 0; z < n; z++)
+        for (int x = 0; x < n; x++)
+        {
+            std::complex<double> sum = 0.0;
+            for (int kz = 0; kz < n; kz++)
+                for (int kx = 0; kx < n; kx++)
+                    sum += std::complex<double>(input[kz * n + kx]) * std::polar(1.0, 2.0 * M_PI * ((double)kx * x + (double)kz * z) / n);
+            maxError = std::max(maxError, std::abs(sum - std::complex<double>(output[z * n + x])));
+        }
+
+    return maxError;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<int> sizes;
+    for (int i = 1; i < argc; i++)
+        sizes.push_back(std::atoi(argv[i]));
+    if (sizes.empty())
+        sizes = {256, 512};
+
+    ThreadPool pool;
+    ThreadPool serial(1);
+
+    std::printf("%u threads; 2D FFT max error vs direct DFT: 16x16 %.2e, 32x32 %.2e (radix-2 pass), 64x64 %.2e\n", pool.size(), checkFFT(16, pool), checkFFT(32, pool), checkFFT(64, pool));
+    std::printf("%6s %8s %14s %14s %16s %14s\n", "size", "threads", "update ms", "updates/s", "3 FFTs ms", "Mpoints/s");
+
+    for (int n : sizes)
+        for (ThreadPool *threads : {&serial, &pool})
+        {
+            OceanFFT ocean(n, 100.0f, OceanSpectrum::JONSWAP, 5.0f, 0.5f, 20000.0f, 1.0f, *threads);
+            double updateMs = timeIt([&](int call)
+                                     { ocean.update(call / 60.0f); });
+
+            FFTPlan plan(n);
+            std::vector<complexf> a(n * n, 1.0f), b(n * n, 1.0f), c(n * n, 1.0f);
+            double fftMs = timeIt([&](int)
+                                  { inverseFFT2D(plan, {a.data(), b.data(), c.data()}, *threads); });
+
+            // complex points transformed per second (3 grids of n^2, rows + columns)
+            std::printf("%6d %8u %14.3f %14.1f %16.3f %14.1f\n", n, threads->size(), updateMs, 1000.0 / updateMs, fftMs, 3.0 * n * n / (fftMs * 1000.0));
+
+            if (pool.size() == 1)
+                break;
+        }
+
+    return 0;
+}
@@ -0,0 +1,108 @@
+// Benchmark of the rain particle update: the original array-of-structs loop of Rain::draw (with its per-frame positions vector and std::rand) against RainParticles (scalar, SIMD, SIMD + thread pool).
+// Build from the repository root: g++ -O2 -march=native -pthread bench/rain.cpp -o bench_rain
+// Usage: ./bench_rain [drop counts...]   (default: 10000 100000 1000000 4000000)
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../rain particles.h"
+
+// same rain settings as weather rain.h
+const float spawnHeight = 10.0f;
+const float rainRadius = 20.0f;
+const glm::vec3 fallVelocity = glm::normalize(glm::vec3(1.0f, -4.0f, 0.3f)) * 4.0f;
+const float groundY = -1.0f + 1.0f;
+
+// particle of the original Rain
+struct RainParticle
+{
+    glm::vec3 Position;
+    glm::vec3 Velocity;
+};
+
+//! The particle update of Rain::draw before RainParticles: array of structs, positions gathered into a new vector every frame.
+std::vector<glm::vec3> legacyRain(std::vector<RainParticle> &particles, float dt, glm::vec3 center)
+{
+    std::vector<glm::vec3> positions;
+
+    for (RainParticle &p : particles)
+    {
+        p.Position += p.Velocity * dt;
+
+        if (p.Position.y <= groundY)
+        {
+            float randomOffset = static_cast<float>(std::rand()) / (static_cast<float>(RAND_MAX / 10.0f));
+            float randomAngle = (std::rand() / (float)RAND_MAX) * 2.0f * (float)M_PI;
+            float randomRadius = std::sqrt(std::rand() / (float)RAND_MAX) * rainRadius;
+            p.Position = glm::vec3(center.x + randomRadius * cos(randomAngle), spawnHeight + randomOffset, center.z + randomRadius * sin(randomAngle));
+            p.Velocity = fallVelocity;
+        }
+
+        positions.push_back(p.Position);
+    }
+
+    return positions;
+}
+
+//! Average milliseconds per frame of update(dt), after 10 s of simulated warm-up (so drops respawn at the steady rate, not all at once), repeated for at least ~0.3 s.
+template <typename F>
+double timeIt(F update)
+{
+    using clock = std::chrono::steady_clock;
+    const float dt = 1.0f / 60.0f;
+    for (int frame = 0; frame < 600; frame++)
+        update(dt);
+
+    int calls = 0;
+    auto start = clock::now();
+
+    do
+    {
+        update(dt);
+        calls++;
+    } while (std::chrono::duration<double>(clock::now() - start).count() < 0.3);
+
+    return std::chrono::duration<double, std::milli>(clock::now() - start).count() / calls;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<int> counts;
+    for (int i = 1; i < argc; i++)
+        counts.push_back(std::atoi(argv[i]));
+    if (counts.empty())
+        counts = {10000, 100000, 1000000, 4000000};
+
+    glm::vec3 center(0.0f, 5.0f, 0.0f);
+    std::srand(1);
+    const uint64_t seed = 1; // same drops on every run
+
+    ThreadPool pool;
+    ThreadPool serial(1);
+
+    std::printf("SIMD width %d, %u threads\n", simd::width, pool.size());
+    std::printf("%9s %12s %12s %12s %12s %9s %14s\n", "drops", "legacy ms", "scalar ms", "simd ms", "simd+mt ms", "speedup", "Mdrops/s");
+
+    for (int n : counts)
+    {
+        std::vector<RainParticle> legacy(n);
+        RainParticles scalar(n, fallVelocity, spawnHeight, rainRadius, serial, seed), vectorized(n, fallVelocity, spawnHeight, rainRadius, serial, seed), threaded(n, fallVelocity, spawnHeight, rainRadius, pool, seed);
+        scalar.vectorize = false;
+        std::vector<float> out(3 * vectorized.capacity); // stands for the mapped vertex buffer
+
+        double legacyMs = timeIt([&](float dt)
+                                 { legacyRain(legacy, dt, center); });
+        double scalarMs = timeIt([&](float dt)
+                                 { scalar.update(dt, groundY, center, out.data()); });
+        double simdMs = timeIt([&](float dt)
+                               { vectorized.update(dt, groundY, center, out.data()); });
+        double threadedMs = timeIt([&](float dt)
+                                   { threaded.update(dt, groundY, center, out.data()); });
+
+        std::printf("%9d %12.3f %12.3f %12.3f %12.3f %8.1fx %14.1f\n", n, legacyMs, scalarMs, simdMs, threadedMs, legacyMs / threadedMs, n / (threadedMs * 1000.0));
+    }
+
+    return 0;
+}
@@ -0,0 +1,167 @@
+// Benchmark of the CPU water waves: the original per-quad lambda path of Water::draw against WaveSolver (scalar, SIMD, SIMD + thread pool).
+// Build from the repository root: g++ -O2 -march=native -pthread bench/waves.cpp -o bench_waves
+// Usage: ./bench_waves [grid sizes...]   (default: 100 256 512 1024 2048)
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "../wave solver.h"
+
+// same wave settings as 2 water.h
+const float waterHorizontalScale = 200.0f;
+const float waveAmp = 0.6f;
+const float waveFreq = 2.0f * glm::pi<float>() / 20.0f;
+const float waveSpeed = 1.0f;
+
+//! The mesh generation of Water::draw before WaveSolver: 6 unshared vertices per quad, 5 wave evaluations per vertex (position + central-difference normal).
+void legacyWaves(std::vector<float> &vertices, int grid, float time)
+{
+    float worldStep = 2.0f / grid;
+
+    auto computePosition = [&](float x, float z)
+    {
+        glm::vec3 pos{x, 0.0f, z};
+
+        float xPhase = waveFreq * (x * waterHorizontalScale) - waveSpeed * time;
+        pos.x += (waveAmp / waterHorizontalScale) * cos(xPhase);
+        pos.y += waveAmp * sin(xPhase);
+
+        float zPhase = waveFreq * (z * waterHorizontalScale) - waveSpeed * time;
+        pos.z += (waveAmp / waterHorizontalScale) * cos(zPhase);
+        pos.y += waveAmp * sin(zPhase);
+
+        return pos;
+    };
+
+    auto computeNormal = [&](float x, float z)
+    {
+        glm::vec3 v10 = computePosition(x, z - worldStep);
+        glm::vec3 v12 = computePosition(x, z + worldStep);
+        glm::vec3 v21 = computePosition(x - worldStep, z);
+        glm::vec3 v01 = computePosition(x + worldStep, z);
+
+        glm::vec3 dvdx = (v01 - v21) / (2.0f * worldStep);
+        glm::vec3 dvdz = (v12 - v10) / (2.0f * worldStep);
+
+        return glm::normalize(glm::cross(dvdz, dvdx));
+    };
+
+    auto pack = [&](size_t idx, glm::vec3 pos, glm::vec3 n, float u, float v)
+    {
+        vertices[idx + 0] = pos.x;
+        vertices[idx + 1] = pos.y;
+        vertices[idx + 2] = pos.z;
+        vertices[idx + 3] = n.x;
+        vertices[idx + 4] = n.y;
+        vertices[idx + 5] = n.z;
+        vertices[idx + 6] = u;
+        vertices[idx + 7] = v;
+    };
+
+    for (int i = 0; i < grid; ++i)
+    {
+        float z0 = -1.0f + i * worldStep;
+        float z1 = z0 + worldStep;
+
+        for (int j = 0; j < grid; ++j)
+        {
+            float x0 = -1.0f + j * worldStep;
+            float x1 = x0 + worldStep;
+
+            glm::vec3 v00 = computePosition(x0, z0);
+            glm::vec3 v10 = computePosition(x1, z0);
+            glm::vec3 v11 = computePosition(x1, z1);
+            glm::vec3 v01 = computePosition(x0, z1);
+
+            glm::vec3 n00 = computeNormal(x0, z0);
+            glm::vec3 n10 = computeNormal(x1, z0);
+            glm::vec3 n11 = computeNormal(x1, z1);
+            glm::vec3 n01 = computeNormal(x0, z1);
+
+            size_t base = ((size_t)i * grid + j) * 6 * 8;
+
+            pack(base + 0 * 8, v00, n00, 0.0f, 0.0f);
+            pack(base + 1 * 8, v10, n10, 1.0f, 0.0f);
+            pack(base + 2 * 8, v11, n11, 1.0f, 1.0f);
+            pack(base + 3 * 8, v00, n00, 0.0f, 0.0f);
+            pack(base + 4 * 8, v11, n11, 1.0f, 1.0f);
+            pack(base + 5 * 8, v01, n01, 0.0f, 1.0f);
+        }
+    }
+}
+
+//! Average milliseconds per call of update(time), repeated for at least ~0.3 s.
+template <typename F>
+double timeIt(F update)
+{
+    using clock = std::chrono::steady_clock;
+    int calls = 0;
+    float time = 0.0f;
+    auto start = clock::now();
+
+    do
+    {
+        update(time);
+        time += 1.0f / 60.0f;
+        calls++;
+    } while (std::chrono::duration<double>(clock::now() - start).count() < 0.3);
+
+    return std::chrono::duration<double, std::milli>(clock::now() - start).count() / calls;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<int> sizes;
+    for (int i = 1; i < argc; i++)
+        sizes.push_back(std::atoi(argv[i]));
+    if (sizes.empty())
+        sizes = {100, 256, 512, 1024, 2048};
+
+    ThreadPool pool;
+    ThreadPool serial(1);
+
+    std::printf("SIMD width %d, %u threads\n", simd::width, pool.size());
+    std::printf("%6s %12s %12s %12s %12s %9s %12s %12s\n", "grid", "legacy ms", "scalar ms", "simd ms", "simd+mt ms", "speedup", "max pos err", "max n err");
+
+    for (int grid : sizes)
+    {
+        std::vector<float> legacy((size_t)grid * grid * 6 * 8);
+        WaveSolver scalarSolver(grid, serial), simdSolver(grid, serial), threadedSolver(grid, pool);
+        scalarSolver.vectorize = false;
+
+        double legacyMs = timeIt([&](float t)
+                                 { legacyWaves(legacy, grid, t); });
+        double scalarMs = timeIt([&](float t)
+                                 { scalarSolver.update(t, waveAmp, waveFreq, waveSpeed, waterHorizontalScale); });
+        double simdMs = timeIt([&](float t)
+                               { simdSolver.update(t, waveAmp, waveFreq, waveSpeed, waterHorizontalScale); });
+        double threadedMs = timeIt([&](float t)
+                                   { threadedSolver.update(t, waveAmp, waveFreq, waveSpeed, waterHorizontalScale); });
+
+        // accuracy against the legacy mesh (first corner of every quad) at the same time; normals differ by the central-difference error of the legacy path
+        float time = 12.345f;
+        legacyWaves(legacy, grid, time);
+        threadedSolver.update(time, waveAmp, waveFreq, waveSpeed, waterHorizontalScale);
+
+        float posError = 0.0f, normalError = 0.0f;
+        for (int i = 0; i < grid; i++)
+            for (int j = 0; j < grid; j++)
+            {
+                const float *a = &legacy[((size_t)i * grid + j) * 6 * 8];
+                const float *b = &threadedSolver.vertices[((size_t)i * (grid + 1) + j) * 8];
+                for (int c = 0; c < 3; c++)
+                {
+                    posError = std::max(posError, std::abs(a[c] - b[c]));
+                    normalError = std::max(normalError, std::abs(a[3 + c] - b[3 + c]));
+                }
+            }
+
+        std::printf("%6d %12.3f %12.3f %12.3f %12.3f %8.1fx %12.2e %12.2e\n", grid, legacyMs, scalarMs, simdMs, threadedMs, legacyMs / threadedMs, posError, normalError);
+    }
+
+    return 0;
+}
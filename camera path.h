@@ -0,0 +1,130 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <glm/glm.hpp>
+
+/*
+   Camera path file: a 12-byte header (magic "CPTH", format version, size of a frame record) followed by one fixed-size record per frame, little-endian.
+   Frames are appended as they are recorded and read back one at a time, so a capture of any length is never held in memory (32 bytes per frame: ~7 MB per hour at 60 fps),
+   and a file cut short (e.g. the program was killed while recording) still replays up to its last complete frame.
+*/
+
+const char cameraPathMagic[4] = {'C', 'P', 'T', 'H'};
+const uint32_t cameraPathVersion = 1;
+const size_t cameraPathBufferSize = 1 << 16; // bytes buffered between writes / reads of the file
+
+// state of one frame of a camera path
+struct CameraPathFrame
+{
+    glm::vec3 position;
+    float yaw, pitch, zoom;
+    float waveAmp;
+    uint32_t toggles; // one bit per recorded scene toggle (showWeather, showLighting, ...), see recordedToggles in main.cpp
+};
+
+static_assert(sizeof(CameraPathFrame) == 32, "camera path records must stay packed: the layout is the file format");
+
+// appends the frames of a camera flight to a camera path file
+class CameraPathWriter
+{
+public:
+    ~CameraPathWriter()
+    {
+        close();
+    }
+
+    //! Creates (or overwrites) the file and writes the header; returns false if the file cannot be created.
+    bool open(const std::string &path)
+    {
+        file = std::fopen(path.c_str(), "wb");
+        if (!file)
+        {
+            std::cout << "Failed to create the camera path " << path << std::endl;
+            return false;
+        }
+
+        std::setvbuf(file, NULL, _IOFBF, cameraPathBufferSize);
+        uint32_t recordSize = sizeof(CameraPathFrame);
+        std::fwrite(cameraPathMagic, 1, sizeof(cameraPathMagic), file);
+        std::fwrite(&cameraPathVersion, sizeof(cameraPathVersion), 1, file);
+        std::fwrite(&recordSize, sizeof(recordSize), 1, file);
+        return true;
+    }
+
+    bool isOpen() const { return file != NULL; }
+
+    void write(const CameraPathFrame &frame)
+    {
+        std::fwrite(&frame, sizeof(frame), 1, file);
+        frames++;
+    }
+
+    void close()
+    {
+        if (!file)
+            return;
+
+        std::fclose(file);
+        file = NULL;
+        std::cout << "Camera path: " << frames << " frames recorded" << std::endl;
+    }
+
+private:
+    FILE *file = NULL;
+    int frames = 0;
+};
+
+// reads the frames of a camera path file back one at a time
+class CameraPathReader
+{
+public:
+    ~CameraPathReader()
+    {
+        if (file)
+            std::fclose(file);
+    }
+
+    //! Opens the file and checks its header; returns false if it is missing or not a camera path of this version.
+    bool open(const std::string &path)
+    {
+        file = std::fopen(path.c_str(), "rb");
+        if (!file)
+        {
+            std::cout << "Failed to open the camera path " << path << std::endl;
+            return false;
+        }
+
+        std::setvbuf(file, NULL, _IOFBF, cameraPathBufferSize);
+        char magic[4];
+        uint32_t version, recordSize;
+        if (std::fread(magic, 1, sizeof(magic), file) != sizeof(magic) || std::memcmp(magic, cameraPathMagic, sizeof(magic)) != 0 ||
+            std::fread(&version, sizeof(version), 1, file) != 1 || version != cameraPathVersion ||
+            std::fread(&recordSize, sizeof(recordSize), 1, file) != 1 || recordSize != sizeof(CameraPathFrame))
+        {
+            std::cout << path << " is not a camera path of version " << cameraPathVersion << std::endl;
+            std::fclose(file);
+            file = NULL;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool isOpen() const { return file != NULL; }
+
+    //! Reads the next frame; returns false at the end of the path.
+    bool read(CameraPathFrame &frame)
+    {
+        return file && std::fread(&frame, sizeof(frame), 1, file) == 1;
+    }
+
+private:
+    FILE *file = NULL;
+};
+
+#endif
@@ -85,6 +85,14 @@ public:
         updateCameraVectors();
     }
 
+    //! Sets the Euler angles directly (e.g. from a replayed camera path).
+    void SetOrientation(float yaw, float pitch)
+    {
+        Yaw = yaw;
+        Pitch = pitch;
+        updateCameraVectors();
+    }
+
     //! Processes input received from any keyboard-like input system; accepts input parameter in the form of camera defined enum (to abstract it from windowing systems) and only updates inputDir vector. The actual movement logic is handled separately, allowing the camera to continue moving even when no keys are pressed.
     void ProcessKeyboard(Camera_Movement dir)
     {
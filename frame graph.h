@@ -0,0 +1,328 @@
+#ifndef FRAME_GRAPH_H
+#define FRAME_GRAPH_H
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// frame graph settings
+const int framePoolStep = 256;   // transient textures are allocated in steps of this many pixels per axis, so that nearby sizes (resolution scales, window resizes) reuse the same storage
+const int framePoolFrames = 120; // storage unused for this many frames is deleted
+
+// format and size of a transient texture
+struct FrameTextureDesc
+{
+    GLenum format;      // sized internal format (a depth format is attached as the depth buffer of the pass writing it)
+    float scale = 1.0f; // resolution relative to the screen, per axis
+};
+
+/*
+   Frame graph: the passes of a frame are declared every frame, in execution order, with the resources they read and write. Compiling the graph culls the passes whose results
+   nothing uses (walking back from the screen) and gives storage to the transient textures, which only live from the first pass writing them to the last pass reading them:
+   the storage comes from a pool kept across frames, and textures whose lifetimes do not overlap share it. Transient sizes follow the screen, so a resize needs no code of its own.
+   Executing the graph binds a framebuffer built from each pass's written textures (cached per set of attachments) with the viewport of their size, then runs the pass.
+*/
+class FrameGraph
+{
+public:
+    //! Starts declaring the frame for a screen of the given size; deletes the pooled storage left unused for framePoolFrames frames.
+    void beginFrame(int width, int height)
+    {
+        frame++;
+        screenWidth = width;
+        screenHeight = height;
+        resources.clear();
+        passes.clear();
+
+        for (size_t i = 0; i < pool.size();)
+        {
+            if (frame - pool[i].lastFrame < framePoolFrames)
+            {
+                i++;
+                continue;
+            }
+            forgetFramebuffers(pool[i].texture);
+            glState.forgetTexture(pool[i].texture);
+            glDeleteTextures(1, &pool[i].texture);
+            pool.erase(pool.begin() + i);
+        }
+    }
+
+    //! Declares the framebuffer the frame is presented in (the window or the headless target): the output of the graph, whose writers are never culled.
+    int importFramebuffer(const char *name, unsigned int framebuffer, int width, int height)
+    {
+        Resource resource = {name, true, true};
+        resource.framebuffer = framebuffer;
+        resource.width = width, resource.height = height;
+        return add(resource);
+    }
+
+    //! Declares a texture owned outside the graph, whose contents persist between frames (array textures are attached by layer: see attachLayer()).
+    int importTexture(const char *name, unsigned int texture, GLenum target, GLenum format, int width, int height)
+    {
+        Resource resource = {name, true, false};
+        resource.texture = texture, resource.target = target;
+        resource.desc.format = format;
+        resource.width = width, resource.height = height;
+        return add(resource);
+    }
+
+    //! Declares a texture that only lives during the frame (its contents are undefined before the first pass writing it).
+    int createTexture(const char *name, const FrameTextureDesc &desc)
+    {
+        Resource resource = {name, false, false};
+        resource.desc = desc;
+        resource.width = std::max(1, (int)std::lround(screenWidth * desc.scale));
+        resource.height = std::max(1, (int)std::lround(screenHeight * desc.scale));
+        return add(resource);
+    }
+
+    //! Declares a pass: it renders into the resources it writes (one framebuffer: an imported one, or the written textures) and samples those it reads.
+    void addPass(const char *name, const std::vector<int> &reads, const std::vector<int> &writes, std::function<void()> execute)
+    {
+        passes.push_back({name, reads, writes, std::move(execute)});
+    }
+
+    //! Culls the passes whose results are not read by a later pass that is not culled, nor presented; assigns storage to the transient textures of the remaining passes.
+    void compile()
+    {
+        std::vector<bool> needed(resources.size(), false);
+        for (auto pass = passes.rbegin(); pass != passes.rend(); ++pass)
+        {
+            pass->culled = std::none_of(pass->writes.begin(), pass->writes.end(), [&](int w)
+                                        { return needed[w] || resources[w].output; });
+            if (!pass->culled)
+                for (int r : pass->reads)
+                    needed[r] = true;
+        }
+
+        // lifetime of each transient texture: index of the last pass using it
+        for (size_t p = 0; p < passes.size(); p++)
+        {
+            if (passes[p].culled)
+                continue;
+            for (const std::vector<int> *list : {&passes[p].reads, &passes[p].writes})
+                for (int r : *list)
+                    resources[r].lastPass = p;
+        }
+
+        // the storage is acquired by the first pass using a texture and released after its last one, for the textures of later passes
+        for (size_t p = 0; p < passes.size(); p++)
+        {
+            if (passes[p].culled)
+                continue;
+            for (const std::vector<int> *list : {&passes[p].reads, &passes[p].writes})
+                for (int r : *list)
+                    if (!resources[r].imported && resources[r].pooled < 0)
+                        resources[r].pooled = acquire(resources[r]);
+            for (Resource &resource : resources)
+                if (!resource.imported && resource.pooled >= 0 && resource.lastPass == (int)p)
+                    pool[resource.pooled].inUse = false;
+        }
+    }
+
+    //! Runs the passes that were not culled, each in its framebuffer and timed under its name.
+    void execute(Profiler &profiler)
+    {
+        for (Pass &pass : passes)
+        {
+            if (pass.culled)
+                continue;
+
+            ProfileScope scope(profiler, pass.name);
+            const Resource &target = resources[pass.writes[0]];
+            glState.bindFramebuffer(GL_FRAMEBUFFER, target.output ? target.framebuffer : framebuffer(pass.writes));
+            glState.viewport(0, 0, target.width, target.height);
+            pass.execute();
+        }
+    }
+
+    //! GL name of a texture: the imported one, or the storage of a transient one (after compile(); 0 if no pass uses it).
+    unsigned int texture(int resource) const
+    {
+        const Resource &r = resources[resource];
+        return r.imported ? r.texture : (r.pooled >= 0 ? pool[r.pooled].texture : 0);
+    }
+
+    //! Lookup region of a transient texture, for the shaders sampling it: xy scales screen coordinates (0 – 1) to the part of the storage in use, zw is the largest coordinate that does not filter in texels beyond it.
+    glm::vec4 region(int resource) const
+    {
+        const Resource &r = resources[resource];
+        if (r.imported || r.pooled < 0)
+            return glm::vec4(1.0f);
+        const PoolTexture &storage = pool[r.pooled];
+        return glm::vec4((float)r.width / storage.width, (float)r.height / storage.height, (r.width - 0.5f) / storage.width, (r.height - 0.5f) / storage.height);
+    }
+
+    int width(int resource) const { return resources[resource].width; }
+    int height(int resource) const { return resources[resource].height; }
+
+    //! Attaches a layer of an imported array texture to the framebuffer of the running pass, in place of the layer attached before (the framebuffer keeps the layer attached last).
+    void attachLayer(int resource, int layer)
+    {
+        const Resource &r = resources[resource];
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, attachment(r.desc.format, 0), r.texture, 0, layer);
+    }
+
+private:
+    struct Resource
+    {
+        const char *name;
+        bool imported, output;
+        unsigned int texture = 0, framebuffer = 0; // imported texture / framebuffer
+        GLenum target = GL_TEXTURE_2D;
+        FrameTextureDesc desc = {GL_NONE};
+        int width = 0, height = 0; // size in use (transient textures: the storage may be larger)
+        int pooled = -1;           // index of the storage in the pool (transient textures)
+        int lastPass = -1;
+    };
+
+    struct Pass
+    {
+        const char *name;
+        std::vector<int> reads, writes;
+        std::function<void()> execute;
+        bool culled = false;
+    };
+
+    struct PoolTexture
+    {
+        unsigned int texture;
+        GLenum format;
+        int width, height;
+        int lastFrame;
+        bool inUse;
+    };
+
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    std::vector<PoolTexture> pool;
+    std::map<std::vector<unsigned int>, unsigned int> framebuffers; // by attached textures
+    int screenWidth = 0, screenHeight = 0;
+    int frame = 0;
+
+    int add(const Resource &resource)
+    {
+        resources.push_back(resource);
+        return resources.size() - 1;
+    }
+
+    static bool isDepth(GLenum format)
+    {
+        return format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F || format == GL_DEPTH24_STENCIL8;
+    }
+
+    //! Attachment point of a texture of the given format (colorIndex: number of color textures attached before it).
+    static GLenum attachment(GLenum format, int colorIndex)
+    {
+        if (format == GL_DEPTH24_STENCIL8)
+            return GL_DEPTH_STENCIL_ATTACHMENT;
+        return isDepth(format) ? GL_DEPTH_ATTACHMENT : GL_COLOR_ATTACHMENT0 + colorIndex;
+    }
+
+    //! Returns the smallest free storage of the texture's format that fits it, or allocates one (rounded up to framePoolStep).
+    int acquire(const Resource &resource)
+    {
+        int best = -1;
+        for (size_t i = 0; i < pool.size(); i++)
+        {
+            const PoolTexture &p = pool[i];
+            if (p.inUse || p.format != resource.desc.format || p.width < resource.width || p.height < resource.height)
+                continue;
+            if (best < 0 || p.width * p.height < pool[best].width * pool[best].height)
+                best = i;
+        }
+
+        if (best < 0)
+        {
+            PoolTexture p = {};
+            p.format = resource.desc.format;
+            p.width = (resource.width + framePoolStep - 1) / framePoolStep * framePoolStep;
+            p.height = (resource.height + framePoolStep - 1) / framePoolStep * framePoolStep;
+
+            glGenTextures(1, &p.texture);
+            glState.bindTexture(GL_TEXTURE_2D, p.texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            if (p.format == GL_DEPTH24_STENCIL8)
+                glTexImage2D(GL_TEXTURE_2D, 0, p.format, p.width, p.height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+            else if (isDepth(p.format))
+                glTexImage2D(GL_TEXTURE_2D, 0, p.format, p.width, p.height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+            else
+                glTexImage2D(GL_TEXTURE_2D, 0, p.format, p.width, p.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+            pool.push_back(p);
+            best = pool.size() - 1;
+        }
+
+        pool[best].inUse = true;
+        pool[best].lastFrame = frame;
+        return best;
+    }
+
+    //! Framebuffer with the given textures attached (built on first use).
+    unsigned int framebuffer(const std::vector<int> &writes)
+    {
+        std::vector<unsigned int> textures;
+        for (int w : writes)
+            textures.push_back(texture(w));
+
+        auto found = framebuffers.find(textures);
+        if (found != framebuffers.end())
+            return found->second;
+
+        unsigned int fbo;
+        glGenFramebuffers(1, &fbo);
+        glState.bindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+        int colors = 0;
+        for (int w : writes)
+        {
+            const Resource &r = resources[w];
+            GLenum point = attachment(r.desc.format, colors);
+            if (r.target == GL_TEXTURE_2D_ARRAY)
+                glFramebufferTextureLayer(GL_FRAMEBUFFER, point, texture(w), 0, 0);
+            else
+                glFramebufferTexture2D(GL_FRAMEBUFFER, point, GL_TEXTURE_2D, texture(w), 0);
+            colors += !isDepth(r.desc.format);
+        }
+
+        // depth-only framebuffer: no color buffer to draw into or read from
+        if (colors == 0)
+        {
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+        }
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Frame graph: framebuffer of " << resources[writes[0]].name << " is not complete" << std::endl;
+
+        framebuffers[textures] = fbo;
+        return fbo;
+    }
+
+    //! Deletes the framebuffers a texture is attached to (before the texture is deleted).
+    void forgetFramebuffers(unsigned int texture)
+    {
+        for (auto it = framebuffers.begin(); it != framebuffers.end();)
+        {
+            if (std::find(it->first.begin(), it->first.end(), texture) == it->first.end())
+            {
+                ++it;
+                continue;
+            }
+            glState.forgetFramebuffer(it->second);
+            glDeleteFramebuffers(1, &it->second);
+            it = framebuffers.erase(it);
+        }
+    }
+};
+
+#endif
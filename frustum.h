@@ -0,0 +1,67 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+// view frustum as 6 clipping planes (ax + by + cz + d >= 0 for points inside), used for CPU visibility culling
+class Frustum
+{
+public:
+    glm::vec4 planes[6]; // left, right, bottom, top, near, far
+
+    //! Extracts the planes directly from a combined view-projection matrix (Gribb-Hartmann method), so it works for any pass: perspective camera, reflected camera or orthographic light.
+    Frustum(const glm::mat4 &viewProjection)
+    {
+        // rows of the matrix (glm matrices are column-major: m[column][row])
+        glm::vec4 row[4];
+        for (int i = 0; i < 4; i++)
+            row[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+        planes[0] = row[3] + row[0];
+        planes[1] = row[3] - row[0];
+        planes[2] = row[3] + row[1];
+        planes[3] = row[3] - row[1];
+        planes[4] = row[3] + row[2];
+        planes[5] = row[3] - row[2];
+    }
+
+    //! Returns false only if the axis-aligned box is completely outside of at least one plane (conservative test: boxes near the frustum corners may be reported as visible).
+    bool intersectsBox(const glm::vec3 &boxMin, const glm::vec3 &boxMax) const
+    {
+        for (int i = 0; i < 6; i++)
+        {
+            // test the box corner that lies furthest along the plane normal (positive vertex)
+            glm::vec3 p(planes[i].x >= 0.0f ? boxMax.x : boxMin.x,
+                        planes[i].y >= 0.0f ? boxMax.y : boxMin.y,
+                        planes[i].z >= 0.0f ? boxMax.z : boxMin.z);
+
+            if (planes[i].x * p.x + planes[i].y * p.y + planes[i].z * p.z + planes[i].w < 0.0f)
+                return false;
+        }
+
+        return true;
+    }
+};
+
+//! Replaces the near plane of a perspective projection with the given world-space plane (ax + by + cz + d >= 0 is kept), so that geometry behind the plane is clipped by the rasterizer (oblique near-plane clipping, E. Lengyel).
+//! The far plane is tilted to still contain the original frustum. Only the depth row changes, so screen positions stay the same. The camera must be on the clipped side of the plane; otherwise the projection is returned unchanged.
+glm::mat4 obliqueProjection(const glm::mat4 &projection, const glm::mat4 &view, const glm::vec4 &worldPlane)
+{
+    glm::vec4 plane = glm::transpose(glm::inverse(view)) * worldPlane; // the plane in view space
+    if (plane.w >= 0.0f)
+        return projection; // the camera (view-space origin) is on the kept side
+
+    // view-space corner of the frustum farthest from the plane (the new far plane passes through it), and the plane scaled accordingly
+    glm::vec4 corner((glm::sign(plane.x) + projection[2][0]) / projection[0][0], (glm::sign(plane.y) + projection[2][1]) / projection[1][1], -1.0f, (1.0f + projection[2][2]) / projection[3][2]);
+    glm::vec4 clip = plane * (2.0f / glm::dot(plane, corner));
+
+    // third row = scaled plane - fourth row (near clipping, z >= -w, becomes the plane test)
+    glm::mat4 oblique = projection;
+    oblique[0][2] = clip.x;
+    oblique[1][2] = clip.y;
+    oblique[2][2] = clip.z + 1.0f;
+    oblique[3][2] = clip.w;
+    return oblique;
+}
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#ifdef HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+// headless mode settings (automated benchmarks: a fixed number of frames rendered offscreen, then a frame-time report)
+bool headless = false;                                   // (--headless)
+int headlessFrames = 600;                                // frames to render (--frames <n>)
+unsigned int headlessWidth = 1280, headlessHeight = 720; // resolution of the offscreen framebuffer (--size <width>x<height>)
+std::string headlessScreenshot;                          // file to save the last frame to, as a binary PPM image (--screenshot <file>)
+const int headlessWarmupFrames = 10;                     // first frames left out of the report (first uploads, lazily allocated buffers, shader warm-up of the driver)
+
+#ifdef HEADLESS_EGL
+EGLDisplay headlessDisplay = EGL_NO_DISPLAY;
+EGLContext headlessContext = EGL_NO_CONTEXT;
+
+//! Creates an OpenGL 3.3 core context without a window or a display server: EGL on the Mesa surfaceless platform (llvmpipe on machines without a GPU), or on the default EGL display if that platform is missing. The context has no default framebuffer, so everything is rendered into a HeadlessTarget.
+bool createHeadlessContext()
+{
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay)
+        headlessDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (headlessDisplay == EGL_NO_DISPLAY || !eglInitialize(headlessDisplay, NULL, NULL))
+    {
+        headlessDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (headlessDisplay == EGL_NO_DISPLAY || !eglInitialize(headlessDisplay, NULL, NULL))
+            return false;
+    }
+
+    // any config that can render desktop OpenGL (surface type 0: no window or pbuffer is ever created)
+    const EGLint configAttributes[] = {EGL_SURFACE_TYPE, 0, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    const EGLint contextAttributes[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3, EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE};
+    EGLConfig config;
+    EGLint configCount = 0;
+
+    if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(headlessDisplay, configAttributes, &config, 1, &configCount) || configCount == 0)
+        return false;
+
+    headlessContext = eglCreateContext(headlessDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+    return headlessContext != EGL_NO_CONTEXT && eglMakeCurrent(headlessDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, headlessContext); // without surfaces (EGL_KHR_surfaceless_context)
+}
+
+void destroyHeadlessContext()
+{
+    eglMakeCurrent(headlessDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(headlessDisplay, headlessContext);
+    eglTerminate(headlessDisplay);
+}
+
+void *headlessProcAddress(const char *name)
+{
+    return (void *)eglGetProcAddress(name);
+}
+#endif
+
+// offscreen framebuffer that stands in for the window in headless mode: color and depth / stencil renderbuffers (the same depth format as the window, which the soft fog blits from)
+class HeadlessTarget
+{
+public:
+    unsigned int FBO;
+    int width, height;
+
+    HeadlessTarget(int w, int h) : width(w), height(h)
+    {
+        glGenRenderbuffers(1, &colorRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+        glGenRenderbuffers(1, &depthRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+
+        glGenFramebuffers(1, &FBO);
+        glState.bindFramebuffer(GL_FRAMEBUFFER, FBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Headless framebuffer is not complete" << std::endl;
+    }
+
+    //! Saves the current contents as a binary PPM image (rows flipped, since OpenGL stores the bottom row first).
+    void saveScreenshot(const std::string &path)
+    {
+        std::vector<unsigned char> pixels(3 * width * height);
+        glState.bindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+        FILE *file = std::fopen(path.c_str(), "wb");
+        if (!file)
+        {
+            std::cout << "Failed to save the screenshot to " << path << std::endl;
+            return;
+        }
+
+        std::fprintf(file, "P6\n%d %d\n255\n", width, height);
+        for (int row = height - 1; row >= 0; row--)
+            std::fwrite(&pixels[3 * width * row], 1, 3 * width, file);
+        std::fclose(file);
+    }
+
+private:
+    unsigned int colorRBO, depthRBO;
+};
+
+// frame times of a headless run (each frame is finished with glFinish, so the time covers both its CPU and GPU work)
+class FrameReport
+{
+public:
+    std::vector<double> frameMs;
+
+    void add(int frame, double ms)
+    {
+        if (frame >= headlessWarmupFrames)
+            frameMs.push_back(ms);
+    }
+
+    void print(int width, int height)
+    {
+        if (frameMs.empty())
+            return;
+
+        std::vector<double> sorted = frameMs;
+        std::sort(sorted.begin(), sorted.end());
+
+        double total = 0.0;
+        for (double ms : sorted)
+            total += ms;
+        double average = total / sorted.size();
+
+        std::printf("Headless: %d frames at %dx%d on %s (first %d not measured)\n", (int)sorted.size() + headlessWarmupFrames, width, height, glGetString(GL_RENDERER), headlessWarmupFrames);
+        std::printf("Frame time: avg %.3f ms (%.1f fps), min %.3f, median %.3f, p95 %.3f, p99 %.3f, max %.3f ms\n", average, 1000.0 / average,
+                    sorted.front(), percentile(sorted, 0.5), percentile(sorted, 0.95), percentile(sorted, 0.99), sorted.back());
+    }
+
+private:
+    //! Value below which the given fraction of the sorted times lies (nearest rank).
+    static double percentile(const std::vector<double> &sorted, double fraction)
+    {
+        size_t rank = (size_t)std::ceil(fraction * sorted.size());
+        return sorted[std::max<size_t>(rank, 1) - 1];
+    }
+};
+
+#endif
@@ -6,10 +6,8 @@ bool showLightSource = false;
 const glm::vec3 lightPos = glm::vec3(-10.0f, 6.0f, -10.0f); // world-space position of the light source
 const glm::vec3 lightColor(1.0f);                           // white color
 
-// for shadow mapping
-const glm::mat4 lightProj = glm::ortho(-50.0f, 50.0f, -50.0f, 50.0f, 1.0f, 100.0f); // orthographic projection: directional light emits parallel rays, no perspective distortion
-const glm::mat4 lightView = glm::lookAt(lightPos, glm::vec3(0.0f), WORLDUP);        // position the light at lightPos, looking at the origin (0, 0, 0)
-const glm::mat4 lightSpaceMatrix = lightProj * lightView;
+// for shadow mapping (the orthographic projections of the cascades are fitted to the camera every frame, see shadow cascades.h)
+const glm::mat4 lightView = glm::lookAt(lightPos, glm::vec3(0.0f), WORLDUP); // position the light at lightPos, looking at the origin (0, 0, 0)
 
 // for lighting model
 const float terrainAmbientStrength = 0.2f;
@@ -32,7 +30,6 @@ public:
     {
         shader.use();
         shader.setMat4("model", glm::translate(glm::mat4(1.0f), lightPos));
-        shader.setVec3("lightColor", lightColor);
 
         float vertices[] = {
             -0.5f, -0.5f, -0.5f,
@@ -79,23 +76,28 @@ public:
 
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
-        glBindVertexArray(VAO);
+        glState.bindVertexArray(VAO);
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
         glEnableVertexAttribArray(0);
     }
 
-    void draw(glm::mat4 view, glm::mat4 projection)
+    //! Queues the light cube (if shown) as opaque geometry of the main pass.
+    void submit(RenderQueue &queue)
+    {
+        if (showLightSource)
+            queue.submit(MAIN_PASS, OPAQUE_LAYER, shader.shaderProgram, 0, boxDistance(camera.Position, lightPos - 0.5f, lightPos + 0.5f), [this]
+                         { draw(); });
+    }
+
+    void draw()
     {
         if (showLightSource)
         {
             shader.use();
-            shader.setMat4("view", view);
-            shader.setMat4("projection", projection);
-            glBindVertexArray(VAO);
+            glState.bindVertexArray(VAO);
             glDrawArrays(GL_TRIANGLES, 0, 36);
-            glBindVertexArray(0);
         }
     }
 };
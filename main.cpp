@@ -1,4 +1,8 @@
+#include <chrono>
+#include <cstdio>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <string>
 #include <vector>
 #include <glad/glad.h>                  // library for loading OpenGL functions (like glClear or glViewport)
@@ -11,7 +15,17 @@
 #include "stb_image.h"           // library for image loading
 #include "shader.h"              // implementation of the graphics pipeline
 #include "camera.h"              // implementation of the camera system
+#include "camera path.h"         // recording and replay of camera flights
+#include "frustum.h"             // view frustum culling
+#include "render queue.h"        // draws of the frame sorted by pass, layer, depth and state
 #include "light.h"
+#include "shadow cascades.h"     // cascaded shadow maps fitted to the camera
+#include "shadow cache.h"        // reuse of the shadow map while the light and the terrain do not change
+#include "reflection target.h"   // adaptive resolution of the water reflection
+#include "headless.h"            // offscreen rendering and frame-time report for automated benchmarks
+#include "profiler.h"            // per-pass CPU and GPU timing
+#include "frame graph.h"         // passes declared with their render targets, culled when unused
+#include "uniform buffers.h"     // per-frame camera and per-scene light / fog data shared by all shaders
 #include "weather rain.h"
 #include "weather fog.h"
 #include "1 skybox.h"
@@ -34,16 +48,14 @@ const unsigned int DEFAULT_WINDOW_POS_Y = 100;
 unsigned int currentScreenWidth = DEFAULT_SCR_WIDTH;
 unsigned int currentScreenHeight = DEFAULT_SCR_HEIGHT;
 
-// shadow map resolution
-const unsigned int SHADOW_WIDTH = 4096;
-const unsigned int SHADOW_HEIGHT = 4096;
-
 // create a Camera class instance with a specified position and default values for other parameters, to access its functionality
 Camera ourCamera;
 
 float deltaTime = 0.0f; // time between current frame and last frame
 float lastFrame = 0.0f; // time of last frame
 
+const float FIXED_TIMESTEP = 1.0f / 60.0f; // simulated time per frame in headless mode and camera path replay, so that every run renders the same frames whatever the speed of the machine
+
 bool firstMouse = true;                 // flag to check if the mouse movement is being processed for the first time
 float lastX = DEFAULT_SCR_WIDTH / 2.0;  // starting cursor position (x-axis)
 float lastY = DEFAULT_SCR_HEIGHT / 2.0; // starting cursor position (y-axis)
@@ -51,174 +63,403 @@ float lastY = DEFAULT_SCR_HEIGHT / 2.0; // starting cursor position (y-axis)
 bool showLighting = true;
 bool showWeather = false;
 
-int main()
+Profiler profiler; // per-pass timing (--profile, --trace <file>)
+
+// camera path recording (--record <file>) and replay (--replay <file>)
+CameraPathWriter cameraRecorder;
+CameraPathReader cameraReplay;
+
+// scene toggles stored with each frame of a camera path, one bit each (the order is part of the file format: only append)
+bool *const recordedToggles[] = {&showWeather, &showLighting, &showLightSource, &useTerrainLOD, &gpuWaves, &oceanWaves, &gpuRain, &softFog};
+
+CameraPathFrame captureCameraPathFrame();
+void applyCameraPathFrame(const CameraPathFrame &frame);
+
+int main(int argc, char **argv)
 {
-    // initialize and configure (use core profile mode and OpenGL v3.3)
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    auto startupBegin = std::chrono::steady_clock::now();
 
-    // GLFW window creation
-    GLFWwindow *window = glfwCreateWindow(DEFAULT_SCR_WIDTH, DEFAULT_SCR_HEIGHT, "Terrain Project (Ivan Yazykov)", NULL, NULL);
-    glfwSetWindowPos(window, DEFAULT_WINDOW_POS_X, DEFAULT_WINDOW_POS_Y);
+    // command line options
+    std::string recordPath, replayPath;
+    bool framesGiven = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--stream")
+            streamTerrain = true;
+        else if (arg == "--tile-budget" && i + 1 < argc)
+            tileBudgetMB = std::stoul(argv[++i]);
+        else if (arg == "--rain-drops" && i + 1 < argc)
+            numDrops = std::stoi(argv[++i]);
+        else if (arg == "--gpu-rain")
+            gpuRain = true;
+        else if (arg == "--seed" && i + 1 < argc)
+            randomSeed = std::stoull(argv[++i]);
+        else if (arg == "--fog-stats")
+            reportFogCost = true;
+        else if (arg == "--state-stats")
+            reportStateChanges = true;
+        else if (arg == "--no-shader-cache")
+            useShaderCache = false;
+        else if (arg == "--headless")
+            headless = true;
+        else if (arg == "--frames" && i + 1 < argc)
+            headlessFrames = std::stoi(argv[++i]), framesGiven = true;
+        else if (arg == "--size" && i + 1 < argc)
+            std::sscanf(argv[++i], "%ux%u", &headlessWidth, &headlessHeight);
+        else if (arg == "--screenshot" && i + 1 < argc)
+            headlessScreenshot = argv[++i];
+        else if (arg == "--shadow-cascades" && i + 1 < argc)
+            shadowCascades = std::max(1, std::min(maxShadowCascades, std::stoi(argv[++i])));
+        else if (arg == "--reflection-budget" && i + 1 < argc)
+            reflectionBudgetMs = std::stof(argv[++i]);
+        else if (arg == "--profile")
+            profiler.enabled = true;
+        else if (arg == "--trace" && i + 1 < argc)
+            profiler.enabled = true, profiler.tracePath = argv[++i];
+        else if (arg == "--record" && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc)
+            replayPath = argv[++i];
+    }
 
-    // set OpenGL context and callback
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetScrollCallback(window, scroll_callback);   // register scroll callback
-    glfwSetCursorPosCallback(window, mouse_callback); // register mouse callback
-    glfwSetKeyCallback(window, key_callback);         // register key callback
+    if (!recordPath.empty() && !cameraRecorder.open(recordPath))
+        return -1;
+    if (!replayPath.empty())
+    {
+        if (!cameraReplay.open(replayPath))
+            return -1;
+        if (headless && !framesGiven)
+            headlessFrames = std::numeric_limits<int>::max(); // the whole path
+    }
 
-    // hide and lock the mouse cursor to the window
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    GLFWwindow *window = NULL;
+#ifdef HEADLESS_EGL
+    if (headless)
+    {
+        // offscreen context without a window (no display server needed)
+        if (!createHeadlessContext())
+        {
+            std::cout << "Failed to create a headless OpenGL context" << std::endl;
+            return -1;
+        }
 
-    // load all OpenGL function pointers
-    gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+        // load all OpenGL function pointers
+        gladLoadGLLoader((GLADloadproc)headlessProcAddress);
+    }
+    else
+#endif
+    {
+        // initialize and configure (use core profile mode and OpenGL v3.3)
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        if (headless)
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE); // built without EGL (HEADLESS_EGL): an invisible window provides the context
+
+        // GLFW window creation
+        window = glfwCreateWindow(DEFAULT_SCR_WIDTH, DEFAULT_SCR_HEIGHT, "Terrain Project (Ivan Yazykov)", NULL, NULL);
+        glfwSetWindowPos(window, DEFAULT_WINDOW_POS_X, DEFAULT_WINDOW_POS_Y);
+
+        // set OpenGL context and callback
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetScrollCallback(window, scroll_callback);   // register scroll callback
+        glfwSetCursorPosCallback(window, mouse_callback); // register mouse callback
+        glfwSetKeyCallback(window, key_callback);         // register key callback
+
+        // hide and lock the mouse cursor to the window
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+        // load all OpenGL function pointers
+        gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
+    }
 
     // enable depth testing to ensure correct pixel rendering order in 3D space (depth buffer prevents incorrect overlaying and redrawing of objects)
-    glEnable(GL_DEPTH_TEST);
+    glState.setEnabled(GL_DEPTH_TEST, true);
+
+    glState.setEnabled(GL_BLEND, true);                      // enable blending with the scene for particle emitters
+    glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); // use the opacity value of the particle texture to blend it correctly, ensuring smooth transparency on the edges
 
-    glEnable(GL_BLEND);                                // enable blending with the scene for particle emitters
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); // use the opacity value of the particle texture to blend it correctly, ensuring smooth transparency on the edges
+    glClearColor(0.2f, 0.3f, 0.3f, 1.0f); // background of the screen and of the reflection
 
     // terrain reflections
     // ___________________
 
-    // setup texture, dynamically rendered using the scene from a mirrored camera view
-    unsigned int reflectionTexture;
-    glGenTextures(1, &reflectionTexture);
-    glBindTexture(GL_TEXTURE_2D, reflectionTexture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, DEFAULT_SCR_WIDTH, DEFAULT_SCR_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-
-    // setup framebuffer and renderbuffer
-    // (framebuffer stores the final rendered reflection, while renderbuffer stores depth information (and optionally stencil, for more advanced effects))
-    unsigned int reflectionFBO, reflectionRBO;
-    glGenFramebuffers(1, &reflectionFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, reflectionFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, reflectionTexture, 0); // attach reflection texture as the storage for colors
-    glGenRenderbuffers(1, &reflectionRBO);
-    glBindRenderbuffer(GL_RENDERBUFFER, reflectionRBO);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, DEFAULT_SCR_WIDTH, DEFAULT_SCR_HEIGHT);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, reflectionRBO); // attach renderbuffer as the storage for depth and stencil info
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // texture dynamically rendered using the scene from a mirrored camera view, over the water's part of the screen only, at a resolution scaled to the GPU budget (a transient texture of the frame graph)
+    ReflectionTarget reflectionTarget;
 
     // terrain shadows
     // _______________
 
-    Shader shadowShader("shaders/shadow.vs", "shaders/shadow.fs");
-
-    shadowShader.use();
-    shadowShader.setMat4("model", glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, terrainOffset, 0.0f)));
-    shadowShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-
-    // setup texture, precomputed once as a shadow depth map
+    // setup texture array, one layer of shadow depth per cascade; a cascade is rendered again only when its projection or the terrain geometry changes (ShadowCache)
     unsigned int depthMapTexture;
     glGenTextures(1, &depthMapTexture);
-    glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-
-    // setup framebuffer
-    unsigned int depthMapFBO;
-    glGenFramebuffers(1, &depthMapFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMapTexture, 0); // attach shadow texture as the storage for depth map
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glState.bindTexture(GL_TEXTURE_2D_ARRAY, depthMapTexture);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, shadowMapSize, shadowMapSize, shadowCascades, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL); // imported into the frame graph (it persists between frames), the layer of the cascade being rendered is attached in the shadow pass
+
+    // screen framebuffer
+    // __________________
+
+    // framebuffer the scene is presented in: the window, or an offscreen one at the chosen resolution in headless mode
+    std::unique_ptr<HeadlessTarget> headlessTarget;
+    unsigned int screenFBO = 0;
+    if (headless)
+    {
+        headlessTarget.reset(new HeadlessTarget(headlessWidth, headlessHeight));
+        screenFBO = headlessTarget->FBO;
+        currentScreenWidth = headlessWidth;
+        currentScreenHeight = headlessHeight;
+        showWeather = true; // benchmark the full pipeline
+    }
 
     // initialize entities
     // ___________________
 
+    ThreadPool threadPool; // worker threads for CPU-side simulation
+
+    UniformBuffers uniformBuffers;
+    uniformBuffers.updateScene({glm::vec4(lightPos, 1.0f), glm::vec4(lightColor, 1.0f), fogColor});
+
     Skybox skybox(ourCamera);
-    Water water(ourCamera, skybox.texture, reflectionTexture, depthMapTexture);
+    Water water(ourCamera, skybox.texture, depthMapTexture, threadPool);
     Terrain terrain(ourCamera, skybox.texture, depthMapTexture);
-    Fog fogEmitter(ourCamera, waterLevel);
-    Rain rainEmitter(ourCamera, waterLevel);
+    Fog fogEmitter(ourCamera, waterLevel, threadPool);
+    Rain rainEmitter(ourCamera, waterLevel, threadPool);
     Light lightSource(ourCamera);
+    RenderQueue renderQueue;
+    FrameGraph frameGraph;
+    ShadowCache shadowCaches[maxShadowCascades];
+
+    // startup time (run with --no-shader-cache to compare against compiling every program)
+    double startupSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startupBegin).count();
+    std::cout << "Startup: " << startupSeconds * 1000.0 << " ms, of which shaders " << shaderStats.seconds * 1000.0 << " ms (" << shaderStats.programs << " programs, "
+              << shaderStats.fromCache << " from the cache" << (useShaderCache ? "" : ", cache disabled") << ")" << std::endl;
+
+    FrameReport frameReport;
+    int frame = 0;
 
     // game loop
-    while (!glfwWindowShouldClose(window))
+    while (headless ? frame < headlessFrames : !glfwWindowShouldClose(window))
     {
-        // per-frame time logic
-        float currentFrame = glfwGetTime();
+        auto frameBegin = std::chrono::steady_clock::now();
+
+        // per-frame time logic (fixed time step in headless mode and replay, so that runs are comparable frame for frame)
+        float currentFrame = (headless || cameraReplay.isOpen()) ? frame * FIXED_TIMESTEP : glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
         // handle keyboard input
-        processInput(window);
+        if (!headless)
+            processInput(window);
+
+        // a replayed camera path overrides the input; the program ends with the path
+        if (cameraReplay.isOpen())
+        {
+            CameraPathFrame pathFrame;
+            if (!cameraReplay.read(pathFrame))
+                break;
+            applyCameraPathFrame(pathFrame);
+        }
+        if (cameraRecorder.isOpen())
+            cameraRecorder.write(captureCameraPathFrame());
 
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // clear the color buffer (fill the screen with a clear color) and the depth buffer; otherwise the information of the previous frame stays in these buffers
+        profiler.beginFrame();
+
+        {
+            ProfileScope pass(profiler, "update");
+            terrain.update();
+            if (showWeather)
+                fogEmitter.update(deltaTime); // the fog is sorted on a worker thread while the scene renders
+        }
 
         glm::mat4 view = ourCamera.GetViewMatrix();
         glm::mat4 projection = glm::perspective(glm::radians(ourCamera.Zoom), (float)currentScreenWidth / (float)currentScreenHeight, 0.1f, 100.0f);
 
-        // render reflections
+        // shadow cascades fitted to the view frustum
+        glm::mat4 cascadeProjections[maxShadowCascades];
+        fitShadowCascades(ourCamera, glm::radians(ourCamera.Zoom), (float)currentScreenWidth / (float)currentScreenHeight, 0.1f, lightView, cascadeProjections);
+
+        ShadowsBlock shadows = {};
+        for (int i = 0; i < shadowCascades; i++)
+            shadows.cascades[i] = cascadeProjections[i] * lightView;
+        shadows.cascadeCount = glm::vec4((float)shadowCascades);
+        uniformBuffers.updateShadows(shadows);
+
+        // camera mirrored by the water plane
         glm::vec3 reflectedPosition(ourCamera.Position.x, 2 * waterLevel - ourCamera.Position.y, ourCamera.Position.z); // reflected camera position in world space
         glm::vec3 reflectedFront(ourCamera.Front.x, -ourCamera.Front.y, ourCamera.Front.z);                             // inverted view direction for reflection
         glm::mat4 reflected_view = glm::lookAt(reflectedPosition, reflectedPosition + reflectedFront, WORLDUP);
+        glm::mat4 reflected_projection = obliqueProjection(projection, reflected_view, glm::vec4(0.0f, 1.0f, 0.0f, -(waterLevel - reflectionClipDepth))); // near plane along the water, so the rasterizer clips what is below it (no discard in the terrain shader)
+
+        // cameras of all passes in one buffer update (the light cameras of the cascades keep the main camera position, which the terrain LOD follows)
+        CameraBlock cameras[CAMERA_PASS_COUNT] = {};
+        cameras[MAIN_CAMERA] = {view, projection, glm::vec4(ourCamera.Position, 1.0f)};
+        cameras[REFLECTED_CAMERA] = {reflected_view, reflected_projection, glm::vec4(reflectedPosition, 1.0f)};
+        for (int i = 0; i < shadowCascades; i++)
+            cameras[LIGHT_CAMERA + i] = {lightView, cascadeProjections[i], glm::vec4(ourCamera.Position, 1.0f)};
+        uniformBuffers.updateCameras(cameras);
+
+        // queue the draws of the reflection and main passes: the order they render in follows from their sort keys
+        renderQueue.clear();
+        terrain.submit(renderQueue, REFLECTION_PASS, reflected_view, reflected_projection, showLighting);
+        terrain.submit(renderQueue, MAIN_PASS, view, projection, showLighting);
+        water.submit(renderQueue, currentFrame, deltaTime, showWeather, showLighting);
+        lightSource.submit(renderQueue);
+        skybox.submit(renderQueue, showWeather);
+        if (showWeather)
+        {
+            fogEmitter.submit(renderQueue);
+            rainEmitter.submit(renderQueue, deltaTime);
+        }
+        renderQueue.sort();
+
+        // passes of the frame and their render targets: the shadow cascades (persistent, cached), the reflection (transient, at the adaptive scale) and the screen
+        // a pass runs only if a later one samples what it renders: the reflection when the water is on screen, the shadows when the lighting is on
+        frameGraph.beginFrame(currentScreenWidth, currentScreenHeight);
+        int screen = frameGraph.importFramebuffer("screen", screenFBO, currentScreenWidth, currentScreenHeight);
+        int shadowMap = frameGraph.importTexture("shadow map", depthMapTexture, GL_TEXTURE_2D_ARRAY, GL_DEPTH_COMPONENT24, shadowMapSize, shadowMapSize);
+
+        WaterCoverage waterOnScreen = waterScreenCoverage(projection * view, waterLevel, waterHorizontalScale);
+        WaterCoverage waterInReflection = waterScreenCoverage(projection * reflected_view, waterLevel, waterHorizontalScale);
+        bool reflectionNeeded = reflectionTarget.prepare(waterOnScreen, waterInReflection, currentScreenWidth, currentScreenHeight);
+        int reflection = frameGraph.createTexture("reflection", {GL_RGB8, reflectionTarget.scale});
+        int reflectionDepth = frameGraph.createTexture("reflection depth", {GL_DEPTH24_STENCIL8, reflectionTarget.scale});
+
+        std::vector<int> litReads = showLighting ? std::vector<int>{shadowMap} : std::vector<int>{};
+        std::vector<int> sceneReads = litReads;
+        if (reflectionNeeded)
+            sceneReads.push_back(reflection);
+
+        // render shadows (first, since the reflection pass samples them too): only the cascades whose cached depth map is out of date
+        auto shadowPass = [&]()
+        {
+            for (int i = 0; i < shadowCascades; i++)
+            {
+                if (cacheShadows && !shadowCaches[i].needsUpdate({shadows.cascades[i], shadowMapSize, shadowMapSize, terrain.shadowState()}))
+                    continue;
 
-        glViewport(0, 0, DEFAULT_SCR_WIDTH, DEFAULT_SCR_HEIGHT); // temporarily rescale the scene to default size (a fix to render reflections correctly in fullscreen mode)
-        glBindFramebuffer(GL_FRAMEBUFFER, reflectionFBO);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        terrain.shader.use();
-        terrain.shader.setMat4("view", reflected_view);
-        terrain.shader.setMat4("projection", projection);
-
-        glBindVertexArray(terrain.VAO);
-        glDrawArrays(GL_TRIANGLES, 0, terrain.vertices.size() / 5); // render terrain from the reflected camera perspective
-        glBindVertexArray(0);
+                frameGraph.attachLayer(shadowMap, i);
+                glClear(GL_DEPTH_BUFFER_BIT);
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glViewport(0, 0, currentScreenWidth, currentScreenHeight);
+                uniformBuffers.useCamera((CameraPass)(LIGHT_CAMERA + i));
+                terrain.drawShadow(shadows.cascades[i]); // render terrain from the light's perspective, though drawing shadows
+            }
+        };
+        frameGraph.addPass("shadow", {}, {shadowMap}, shadowPass);
 
-        // render shadows
-        glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT); // temporarily rescale the scene to capture shadows in higher resolution
-        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-        glClear(GL_DEPTH_BUFFER_BIT);
+        // render reflections
+        auto reflectionPass = [&]()
+        {
+            reflectionTarget.begin(frameGraph.width(reflection), frameGraph.height(reflection));
+            uniformBuffers.useCamera(REFLECTED_CAMERA);
+            renderQueue.execute(REFLECTION_PASS); // render terrain from the reflected camera perspective
+            reflectionTarget.end();
+        };
+        frameGraph.addPass("reflection", litReads, {reflection, reflectionDepth}, reflectionPass);
+
+        // render main scene: terrain, water and light cube front to back, then the skybox only where they leave the screen uncovered, then the weather effects blended over the whole scene
+        auto scenePass = [&]()
+        {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // clear the color buffer (fill the screen with a clear color) and the depth buffer; otherwise the information of the previous frame stays in these buffers
+            water.reflectionTexture = frameGraph.texture(reflection); // 0 when the reflection pass is culled (no water on screen to sample it)
+            water.reflectionRegion = frameGraph.region(reflection);
 
-        shadowShader.use();
-        glBindVertexArray(terrain.VAO);
-        glDrawArrays(GL_TRIANGLES, 0, terrain.vertices.size() / 5); // render terrain from the light's perspective, though drawing shadows
-        glBindVertexArray(0);
+            uniformBuffers.useCamera(MAIN_CAMERA);
+            {
+                ProfileScope pass(profiler, "opaque");
+                renderQueue.execute(MAIN_PASS, OPAQUE_LAYER);
+            }
+            {
+                ProfileScope pass(profiler, "skybox");
+                renderQueue.execute(MAIN_PASS, SKY_LAYER);
+            }
+            if (showWeather)
+            {
+                ProfileScope pass(profiler, "weather");
+                renderQueue.execute(MAIN_PASS, TRANSPARENT_LAYER);
+            }
+        };
+        frameGraph.addPass("scene", sceneReads, {screen}, scenePass);
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glViewport(0, 0, currentScreenWidth, currentScreenHeight);
+        frameGraph.compile();
+        frameGraph.execute(profiler);
 
-        // render main scene
-        skybox.draw(view, projection, showWeather);
-        water.draw(view, projection, currentFrame, deltaTime, reflected_view, showWeather, showLighting);
-        terrain.draw(view, projection, showLighting);
+        profiler.endFrame();
+        glState.endFrame();
 
-        // render weather effects
-        if (showWeather)
+        if (headless)
         {
-            fogEmitter.draw(deltaTime, view, projection);
-            rainEmitter.draw(deltaTime, view, projection);
+            glFinish(); // wait for the GPU, so that the frame time includes its rendering (there is no swap to throttle the loop)
+            frameReport.add(frame, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameBegin).count());
+            frame++;
+            continue;
         }
 
-        // render light cube
-        lightSource.draw(view, projection);
+        frame++;
 
         glfwSwapBuffers(window); // make the contents of the back buffer (stores the completed frames) visible on the screen
         glfwPollEvents();        // if any events are triggered (like keyboard input or mouse movement events), updates the window state, and calls the corresponding functions (which we can register via callback methods)
     }
 
+    cameraRecorder.close();
+
+    if (profiler.enabled)
+        profiler.printStatistics();
+    profiler.writeTrace();
+
+    if (headless)
+    {
+        frameReport.print(headlessWidth, headlessHeight);
+        if (!headlessScreenshot.empty())
+            headlessTarget->saveScreenshot(headlessScreenshot);
+    }
+
+#ifdef HEADLESS_EGL
+    if (headless)
+    {
+        headlessTarget.reset();
+        destroyHeadlessContext();
+        return 0;
+    }
+#endif
+
     // terminate, clearing all previously allocated GLFW resources
     glfwTerminate();
     return 0;
 }
 
+//! State of the current frame for a camera path: the camera and the scene toggles.
+CameraPathFrame captureCameraPathFrame()
+{
+    CameraPathFrame frame = {ourCamera.Position, ourCamera.Yaw, ourCamera.Pitch, ourCamera.Zoom, waveAmp, 0};
+    for (size_t i = 0; i < sizeof(recordedToggles) / sizeof(recordedToggles[0]); i++)
+        frame.toggles |= (uint32_t)*recordedToggles[i] << i;
+    return frame;
+}
+
+//! Restores the camera and the scene toggles of a camera path frame.
+void applyCameraPathFrame(const CameraPathFrame &frame)
+{
+    ourCamera.Position = frame.position;
+    ourCamera.SetOrientation(frame.yaw, frame.pitch);
+    ourCamera.Zoom = frame.zoom;
+    waveAmp = frame.waveAmp;
+    for (size_t i = 0; i < sizeof(recordedToggles) / sizeof(recordedToggles[0]); i++)
+        *recordedToggles[i] = (frame.toggles >> i) & 1;
+}
+
 // whenever the window size changed (by OS or user resize), this callback function executes
 void framebuffer_size_callback(GLFWwindow *window, int width, int height)
 {
-    glViewport(0, 0, width, height);
+    // the frame graph sizes the screen pass and the transient targets from the screen size every frame (a minimized window reports 0 x 0: keep the last size)
+    if (width == 0 || height == 0)
+        return;
+    currentScreenWidth = width;
+    currentScreenHeight = height;
 }
 
 // whenever the mouse uses scroll wheel, this callback function executes
@@ -272,6 +513,24 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
         case GLFW_KEY_M:
             showLightSource = !showLightSource;
             break;
+        case GLFW_KEY_T:
+            useTerrainLOD = !useTerrainLOD;
+            break;
+        case GLFW_KEY_G:
+            gpuWaves = !gpuWaves;
+            break;
+        case GLFW_KEY_O:
+            oceanWaves = !oceanWaves;
+            break;
+        case GLFW_KEY_R:
+            gpuRain = !gpuRain;
+            break;
+        case GLFW_KEY_P:
+            softFog = !softFog;
+            break;
+        case GLFW_KEY_C:
+            cacheShadows = !cacheShadows;
+            break;
         case GLFW_KEY_F:
         {
             isFullscreen = !isFullscreen;
@@ -0,0 +1,274 @@
+#ifndef OCEAN_FFT_H
+#define OCEAN_FFT_H
+
+#include <cmath>
+#include <complex>
+#include <random>
+#include <vector>
+#include "thread pool.h"
+
+typedef std::complex<float> complexf;
+
+// written out instead of std::complex operator*, which handles inf / nan cases and does not vectorize without -ffast-math
+inline complexf cmul(complexf a, complexf b) { return complexf(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real()); }
+inline complexf mulI(complexf a) { return complexf(-a.imag(), a.real()); } // i * a
+
+// precomputed inverse FFT of a power of 2 size: in-place decimation in frequency, radix-4 passes (+ one radix-2 pass for odd powers of 2), then bit-reversal permutation
+class FFTPlan
+{
+public:
+    int size;
+
+    FFTPlan(int n)
+        : size(n)
+    {
+        twiddles.resize(n);
+        for (int k = 0; k < n; k++)
+            twiddles[k] = std::polar(1.0f, 2.0f * (float)M_PI * k / n); // e^(+2 pi i k / n): inverse transform
+
+        int bits = 0;
+        while ((1 << bits) < n)
+            bits++;
+
+        bitReverse.resize(n);
+        for (int k = 0; k < n; k++)
+        {
+            int reversed = 0;
+            for (int b = 0; b < bits; b++)
+                reversed |= ((k >> b) & 1) << (bits - 1 - b);
+            bitReverse[k] = reversed;
+        }
+    }
+
+    //! Unnormalized inverse transform (x[m] = sum_k X[k] e^(2 pi i k m / n)) of batch interleaved sequences: element k of sequence b is x[k * batch + b]. Batches of neighbouring columns keep the inner loop contiguous.
+    template <int batch>
+    void inverse(complexf *x) const
+    {
+        int span = size;
+
+        // radix-4 butterfly = 2 fused radix-2 passes (same output order, 3 twiddle multiplications instead of 4)
+        for (; span >= 4; span /= 4)
+        {
+            int quarter = span / 4, stride = size / span;
+
+            for (int start = 0; start < size; start += span)
+                for (int j = 0; j < quarter; j++)
+                {
+                    complexf w1 = twiddles[j * stride], w2 = twiddles[2 * j * stride], w3 = twiddles[3 * j * stride];
+                    complexf *p0 = x + (start + j) * batch, *p1 = p0 + quarter * batch, *p2 = p1 + quarter * batch, *p3 = p2 + quarter * batch;
+
+                    for (int b = 0; b < batch; b++)
+                    {
+                        complexf a0 = p0[b] + p2[b], a1 = p1[b] + p3[b];
+                        complexf a2 = p0[b] - p2[b], a3 = mulI(p1[b] - p3[b]);
+
+                        p0[b] = a0 + a1;
+                        p1[b] = cmul(a0 - a1, w2);
+                        p2[b] = cmul(a2 + a3, w1);
+                        p3[b] = cmul(a2 - a3, w3);
+                    }
+                }
+        }
+
+        if (span == 2)
+            for (int start = 0; start < size; start += 2)
+                for (int b = 0; b < batch; b++)
+                {
+                    complexf a = x[start * batch + b], c = x[(start + 1) * batch + b];
+                    x[start * batch + b] = a + c;
+                    x[(start + 1) * batch + b] = a - c;
+                }
+
+        for (int k = 0; k < size; k++)
+            if (k < bitReverse[k])
+                for (int b = 0; b < batch; b++)
+                    std::swap(x[k * batch + b], x[bitReverse[k] * batch + b]);
+    }
+
+private:
+    std::vector<complexf> twiddles;
+    std::vector<int> bitReverse;
+};
+
+const int fftColumnBlock = 8; // columns transformed together (8 complex floats = one 64-byte cache line per row)
+
+//! In-place 2D inverse FFT of several size x size row-major grids: rows in parallel, then blocks of columns gathered into a contiguous buffer, transformed as a batch and scattered back.
+inline void inverseFFT2D(const FFTPlan &plan, const std::vector<complexf *> &grids, ThreadPool &pool)
+{
+    int n = plan.size;
+    int rows = n * grids.size();
+
+    pool.parallelFor(0, rows, std::max(1, rows / (int)(4 * pool.size())), [&](int first, int last)
+                     {
+                         for (int r = first; r < last; r++)
+                             plan.inverse<1>(grids[r / n] + (r % n) * n); });
+
+    int blocks = n / fftColumnBlock * grids.size();
+    pool.parallelFor(0, blocks, 1, [&](int first, int last)
+                     {
+                         thread_local std::vector<complexf> block;
+                         block.resize(n * fftColumnBlock);
+
+                         for (int b = first; b < last; b++)
+                         {
+                             complexf *grid = grids[b / (n / fftColumnBlock)];
+                             int column = (b % (n / fftColumnBlock)) * fftColumnBlock;
+
+                             for (int r = 0; r < n; r++)
+                                 for (int c = 0; c < fftColumnBlock; c++)
+                                     block[r * fftColumnBlock + c] = grid[r * n + column + c];
+
+                             plan.inverse<fftColumnBlock>(block.data());
+
+                             for (int r = 0; r < n; r++)
+                                 for (int c = 0; c < fftColumnBlock; c++)
+                                     grid[r * n + column + c] = block[r * fftColumnBlock + c];
+                         } });
+}
+
+enum class OceanSpectrum
+{
+    Phillips, // Tessendorf's empirical spectrum, amplitude set by a constant
+    JONSWAP   // fetch-limited wind sea (Hasselmann et al.), amplitude follows from wind speed and fetch
+};
+
+// Tessendorf ocean: a tiling patch of patchSize x patchSize world units, evaluated every frame by inverse FFTs of a random spectrum animated with the deep water dispersion relation w = sqrt(g k); independent of OpenGL
+class OceanFFT
+{
+public:
+    int size;                        // FFT size = texels per side of the output (power of 2, at least fftColumnBlock)
+    float patchSize;                 // world-space side of the patch
+    std::vector<float> displacement; // size^2 x 4: horizontal (choppy) x displacement, height, z displacement, 0 (world units)
+    std::vector<float> slope;        // size^2 x 2: d height / dx, d height / dz
+
+    OceanFFT(int n, float patch, OceanSpectrum spectrum, float windSpeed, float windAngle, float fetch, float choppiness, ThreadPool &threads, unsigned int seed = 1)
+        : size(n),
+          patchSize(patch),
+          plan(n),
+          pool(threads)
+    {
+        displacement.resize(n * n * 4);
+        slope.resize(n * n * 2);
+        h0.resize(n * n);
+        omega.resize(n * n);
+        kx.resize(n * n);
+        kz.resize(n * n);
+        heightX.resize(n * n);
+        lateralSlope.resize(n * n);
+        slopeZ.resize(n * n);
+
+        const float g = 9.81f;
+        float dk = 2.0f * (float)M_PI / patchSize;
+        float windX = std::cos(windAngle), windZ = std::sin(windAngle);
+
+        // JONSWAP parameters for the given wind and fetch
+        float peakOmega = 22.0f * std::cbrt(g * g / (windSpeed * fetch));
+        float alpha = 0.076f * std::pow(windSpeed * windSpeed / (fetch * g), 0.22f);
+
+        std::mt19937 generator(seed);
+        std::normal_distribution<float> gaussian;
+
+        for (int z = 0; z < n; z++)
+            for (int x = 0; x < n; x++)
+            {
+                // FFT index m stands for the wave number (m < n / 2 ? m : m - n) * dk
+                int mx = x < n / 2 ? x : x - n, mz = z < n / 2 ? z : z - n;
+                float kX = mx * dk, kZ = mz * dk, k = std::sqrt(kX * kX + kZ * kZ);
+                int i = z * n + x;
+
+                kx[i] = kX, kz[i] = kZ;
+                omega[i] = std::sqrt(g * k);
+
+                float xi1 = gaussian(generator), xi2 = gaussian(generator); // drawn for every mode, so the sea does not change with the spectrum parameters
+
+                // the Nyquist row / column has no conjugate partner (it would make the output complex), the mean level stays 0
+                if (k == 0.0f || mx == -n / 2 || mz == -n / 2)
+                {
+                    h0[i] = 0.0f;
+                    continue;
+                }
+
+                float cosTheta = (kX * windX + kZ * windZ) / k;
+                float density; // spectral density per unit wave vector area
+
+                if (spectrum == OceanSpectrum::Phillips)
+                {
+                    float largestWave = windSpeed * windSpeed / g;
+                    float smallestWave = largestWave * 0.001f;
+                    density = phillipsAmplitude * std::exp(-1.0f / (k * largestWave * k * largestWave)) / (k * k * k * k) * cosTheta * cosTheta * std::exp(-k * k * smallestWave * smallestWave);
+                }
+                else
+                {
+                    // S(w) in frequency, converted to wave vector space: F(kx, kz) = S(w) D(theta) (dw / dk) / k, with cos^2 spreading towards the wind only
+                    float w = omega[i];
+                    float sigma = w <= peakOmega ? 0.07f : 0.09f;
+                    float r = std::exp(-(w - peakOmega) * (w - peakOmega) / (2.0f * sigma * sigma * peakOmega * peakOmega));
+                    float s = alpha * g * g / std::pow(w, 5.0f) * std::exp(-1.25f * std::pow(peakOmega / w, 4.0f)) * std::pow(3.3f, r);
+                    float spreading = cosTheta > 0.0f ? 2.0f / (float)M_PI * cosTheta * cosTheta : 0.0f;
+                    density = s * spreading * (g / (2.0f * w)) / k;
+                }
+
+                // E|h(k, t)|^2 = (F(k) + F(-k)) dk^2 / 2, so the height variance sums to the variance of the spectrum
+                h0[i] = complexf(xi1, xi2) * std::sqrt(density * 0.25f) * dk;
+            }
+
+        // choppiness is folded into the horizontal displacement terms of the spectrum
+        lambda = choppiness;
+    }
+
+    //! Evaluates the patch at the given time: spectrum at t, 3 complex inverse 2D FFTs, then packing into displacement / slope.
+    void update(float time)
+    {
+        int n = size;
+
+        /* h(k, t) = h0(k) e^(i w t) + conj(h0(-k)) e^(-i w t)
+           Each inverse FFT output is real, so 2 real fields are packed into one complex FFT (A + i B):
+           heightX      = h + i Dx,  Dx = -i lambda kx / k h  ->  h (1 + lambda kx / k)
+           lateralSlope = Dz + i Sx, Sx = i kx h, Dz = -i lambda kz / k h
+           slopeZ       = Sz = i kz h */
+        pool.parallelFor(0, n, std::max(1, n / (int)(4 * pool.size())), [&](int first, int last)
+                         {
+                             for (int z = first; z < last; z++)
+                                 for (int x = 0; x < n; x++)
+                                 {
+                                     int i = z * n + x;
+                                     int mirrored = ((n - z) % n) * n + (n - x) % n; // index of -k
+
+                                     complexf phase = std::polar(1.0f, omega[i] * time);
+                                     complexf h = cmul(h0[i], phase) + cmul(std::conj(h0[mirrored]), std::conj(phase));
+
+                                     float k = std::sqrt(kx[i] * kx[i] + kz[i] * kz[i]);
+                                     float ux = k > 0.0f ? kx[i] / k : 0.0f, uz = k > 0.0f ? kz[i] / k : 0.0f;
+
+                                     heightX[i] = h * (1.0f + lambda * ux);
+                                     lateralSlope[i] = mulI(h) * (-lambda * uz) - h * kx[i];
+                                     slopeZ[i] = mulI(h) * kz[i];
+                                 } });
+
+        inverseFFT2D(plan, {heightX.data(), lateralSlope.data(), slopeZ.data()}, pool);
+
+        pool.parallelFor(0, n, std::max(1, n / (int)(4 * pool.size())), [&](int first, int last)
+                         {
+                             for (int i = first * n; i < last * n; i++)
+                             {
+                                 displacement[i * 4 + 0] = heightX[i].imag();
+                                 displacement[i * 4 + 1] = heightX[i].real();
+                                 displacement[i * 4 + 2] = lateralSlope[i].real();
+                                 displacement[i * 4 + 3] = 0.0f;
+                                 slope[i * 2 + 0] = lateralSlope[i].imag();
+                                 slope[i * 2 + 1] = slopeZ[i].real();
+                             } });
+    }
+
+private:
+    static constexpr float phillipsAmplitude = 0.0018f; // Phillips constant A (tuned for heights similar to the JONSWAP defaults)
+
+    FFTPlan plan;
+    ThreadPool &pool;
+    float lambda;
+    std::vector<complexf> h0;           // initial spectrum amplitudes
+    std::vector<float> omega, kx, kz;   // per mode angular frequency and wave vector
+    std::vector<complexf> heightX, lateralSlope, slopeZ; // packed FFT inputs / outputs (see update)
+};
+
+#endif
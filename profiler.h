@@ -0,0 +1,249 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+
+// profiler settings
+const int profileWindow = 300;             // frames of the rolling statistics (printed every profileWindow frames and on exit)
+const size_t profileTraceEvents = 1 << 20; // events kept for the trace file (~32 MB), later ones are dropped
+
+/*
+   Per-pass CPU and GPU timing. The GPU times come from timestamp queries (glQueryCounter) written at the start and end of each pass and read back one frame later,
+   if they are available by then (double-buffered by frame parity; a late result is dropped rather than waited for, so the CPU never stalls on the GPU).
+   Timestamps are used instead of GL_TIME_ELAPSED because those queries cannot be nested or overlap, and the passes contain other timer queries (--fog-stats).
+   When disabled, a scope costs one branch.
+*/
+class Profiler
+{
+public:
+    bool enabled = false;
+    std::string tracePath; // Chrome trace (chrome://tracing, Perfetto) written on exit if not empty
+
+    //! Starts a frame: collects the GPU times of the previous frames that are ready.
+    void beginFrame()
+    {
+        if (!enabled)
+            return;
+
+        if (frame == 0)
+        {
+            // offset between the GPU and the CPU clocks, to place the GPU passes on the timeline of the trace
+            GLint64 gpuNow;
+            glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+            gpuToCpuUs = nowUs() - gpuNow * 1e-3;
+        }
+
+        collectGPU();
+        frameStartUs = nowUs();
+    }
+
+    //! Ends a frame; prints the statistics every profileWindow frames.
+    void endFrame()
+    {
+        if (!enabled)
+            return;
+
+        addTraceEvent("frame", cpuTrack, frameStartUs, nowUs() - frameStartUs);
+        if (++frame % profileWindow == 0)
+            printStatistics();
+    }
+
+    //! Starts timing the pass of the given name (a string literal: passes are told apart by their name); returns its index.
+    int beginPass(const char *name)
+    {
+        int index = findPass(name);
+        Pass &pass = passes[index];
+        int buffer = frame % 2;
+
+        if (pass.pending[buffer])
+            droppedSamples++; // the result of two frames ago is still not available: reuse the queries instead of waiting
+        glQueryCounter(pass.gpuBegin[buffer], GL_TIMESTAMP);
+        pass.pending[buffer] = true;
+        pass.cpuStartUs[buffer] = nowUs();
+        return index;
+    }
+
+    void endPass(int index)
+    {
+        Pass &pass = passes[index];
+        int buffer = frame % 2;
+
+        glQueryCounter(pass.gpuEnd[buffer], GL_TIMESTAMP);
+        double durationUs = nowUs() - pass.cpuStartUs[buffer];
+        addSample(pass.cpuMs, pass.cpuSamples, durationUs * 1e-3);
+        addTraceEvent(pass.name, cpuTrack, pass.cpuStartUs[buffer], durationUs);
+    }
+
+    //! Prints min / avg / p99 of the CPU and GPU time of each pass over the last profileWindow frames.
+    void printStatistics()
+    {
+        char title[64];
+        std::snprintf(title, sizeof(title), "Profile, last %d frames (ms)", std::min(frame, profileWindow));
+        std::printf("%-28s %23s   %23s\n", title, "CPU min / avg / p99", "GPU min / avg / p99");
+        for (Pass &pass : passes)
+        {
+            double cpu[3], gpu[3];
+            statistics(pass.cpuMs, cpu);
+            statistics(pass.gpuMs, gpu);
+            std::printf("  %-26s %7.3f %7.3f %7.3f   %7.3f %7.3f %7.3f\n", pass.name, cpu[0], cpu[1], cpu[2], gpu[0], gpu[1], gpu[2]);
+        }
+        if (droppedSamples > 0)
+            std::printf("  (%d GPU samples dropped: results not ready after a frame)\n", droppedSamples);
+    }
+
+    //! Writes the recorded events as a Chrome trace (JSON array of complete events, CPU and GPU on separate tracks).
+    void writeTrace()
+    {
+        if (!enabled || tracePath.empty())
+            return;
+
+        FILE *file = std::fopen(tracePath.c_str(), "w");
+        if (!file)
+        {
+            std::cout << "Failed to write the profile trace to " << tracePath << std::endl;
+            return;
+        }
+
+        std::fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+        std::fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"CPU\"}},\n", cpuTrack);
+        std::fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"GPU\"}}", gpuTrack);
+        for (const TraceEvent &event : events)
+            std::fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}", event.name, event.track, event.startUs, event.durationUs);
+        std::fprintf(file, "\n]}\n");
+        std::fclose(file);
+
+        std::cout << "Profile trace: " << events.size() << " events written to " << tracePath << std::endl;
+    }
+
+private:
+    static const int cpuTrack = 1, gpuTrack = 2;
+
+    struct Pass
+    {
+        const char *name;
+        unsigned int gpuBegin[2], gpuEnd[2]; // timestamp queries of the even and odd frames
+        bool pending[2] = {false, false};    // queries written and not read yet
+        double cpuStartUs[2];
+        std::vector<float> cpuMs, gpuMs; // rolling windows of profileWindow samples
+        long cpuSamples = 0, gpuSamples = 0;
+    };
+
+    struct TraceEvent
+    {
+        const char *name;
+        int track;
+        double startUs, durationUs;
+    };
+
+    std::vector<Pass> passes;
+    std::vector<TraceEvent> events;
+    int frame = 0, droppedSamples = 0;
+    double frameStartUs = 0.0, gpuToCpuUs = 0.0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    double nowUs() const
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    int findPass(const char *name)
+    {
+        for (size_t i = 0; i < passes.size(); i++)
+            if (passes[i].name == name || std::strcmp(passes[i].name, name) == 0)
+                return i;
+
+        passes.emplace_back();
+        Pass &pass = passes.back();
+        pass.name = name;
+        glGenQueries(2, pass.gpuBegin);
+        glGenQueries(2, pass.gpuEnd);
+        return passes.size() - 1;
+    }
+
+    //! Reads the GPU timestamps of the passes whose results are available.
+    void collectGPU()
+    {
+        for (Pass &pass : passes)
+            for (int buffer = 0; buffer < 2; buffer++)
+            {
+                if (!pass.pending[buffer])
+                    continue;
+
+                GLint available = 0;
+                glGetQueryObjectiv(pass.gpuEnd[buffer], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available)
+                    continue;
+
+                GLuint64 begin, end;
+                glGetQueryObjectui64v(pass.gpuBegin[buffer], GL_QUERY_RESULT, &begin);
+                glGetQueryObjectui64v(pass.gpuEnd[buffer], GL_QUERY_RESULT, &end);
+                pass.pending[buffer] = false;
+
+                addSample(pass.gpuMs, pass.gpuSamples, (end - begin) * 1e-6);
+                addTraceEvent(pass.name, gpuTrack, begin * 1e-3 + gpuToCpuUs, (end - begin) * 1e-3);
+            }
+    }
+
+    static void addSample(std::vector<float> &window, long &samples, double ms)
+    {
+        if (window.size() < profileWindow)
+            window.push_back(ms);
+        else
+            window[samples % profileWindow] = ms;
+        samples++;
+    }
+
+    //! min, avg and p99 (nearest rank) of a window of samples (zeros if it is empty).
+    static void statistics(const std::vector<float> &window, double result[3])
+    {
+        result[0] = result[1] = result[2] = 0.0;
+        if (window.empty())
+            return;
+
+        std::vector<float> sorted = window;
+        std::sort(sorted.begin(), sorted.end());
+        for (float ms : sorted)
+            result[1] += ms;
+
+        result[0] = sorted.front();
+        result[1] /= sorted.size();
+        result[2] = sorted[std::max<size_t>((size_t)std::ceil(0.99 * sorted.size()), 1) - 1];
+    }
+
+    void addTraceEvent(const char *name, int track, double startUs, double durationUs)
+    {
+        if (!tracePath.empty() && events.size() < profileTraceEvents)
+            events.push_back({name, track, startUs, durationUs});
+    }
+};
+
+// RAII marker of a profiled pass: times the enclosing block on the CPU and the GPU
+class ProfileScope
+{
+public:
+    ProfileScope(Profiler &profiler, const char *name) : profiler(profiler)
+    {
+        if (profiler.enabled)
+            pass = profiler.beginPass(name);
+    }
+
+    ~ProfileScope()
+    {
+        if (pass >= 0)
+            profiler.endPass(pass);
+    }
+
+private:
+    Profiler &profiler;
+    int pass = -1;
+};
+
+#endif
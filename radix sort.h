@@ -0,0 +1,55 @@
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+//! Maps a float to an unsigned key with the same order (negative floats have their bits flipped, positive ones their sign bit set).
+inline uint32_t floatSortKey(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits ^ ((bits >> 31) ? 0xFFFFFFFFu : 0x80000000u);
+}
+
+//! Stable LSD radix sort of values by ascending keys, 8 bits per pass; passes where all keys share the digit are skipped. keys and values are permuted in place, the temp vectors are scratch space kept by the caller between calls.
+inline void radixSort(std::vector<uint32_t> &keys, std::vector<uint32_t> &values, std::vector<uint32_t> &tempKeys, std::vector<uint32_t> &tempValues)
+{
+    size_t n = keys.size();
+    tempKeys.resize(n);
+    tempValues.resize(n);
+
+    // histograms of the 4 digits in one read of the keys
+    uint32_t counts[4][256] = {};
+    for (uint32_t key : keys)
+        for (int digit = 0; digit < 4; digit++)
+            counts[digit][(key >> (8 * digit)) & 0xFF]++;
+
+    for (int digit = 0; digit < 4; digit++)
+    {
+        uint32_t *count = counts[digit];
+        if (n == 0 || count[(keys[0] >> (8 * digit)) & 0xFF] == n)
+            continue;
+
+        uint32_t offset = 0;
+        for (int bucket = 0; bucket < 256; bucket++)
+        {
+            uint32_t size = count[bucket];
+            count[bucket] = offset;
+            offset += size;
+        }
+
+        for (size_t i = 0; i < n; i++)
+        {
+            uint32_t destination = count[(keys[i] >> (8 * digit)) & 0xFF]++;
+            tempKeys[destination] = keys[i];
+            tempValues[destination] = values[i];
+        }
+
+        keys.swap(tempKeys);
+        values.swap(tempValues);
+    }
+}
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef RAIN_PARTICLES_H
+#define RAIN_PARTICLES_H
+
+#include <cmath>
+#include <vector>
+#include <glm/glm.hpp>
+#include "random.h"
+#include "simd.h"
+#include "thread pool.h"
+
+const int rainChunk = 16384; // drops per task of the update (a multiple of simd::width); each chunk has its own random stream, so the rain does not depend on the thread count
+
+// rain drops stored as a structure of arrays (one array per coordinate), so that simd::width drops are advanced and tested for respawn with one instruction each; chunks of drops are updated in parallel; independent of OpenGL
+class RainParticles
+{
+public:
+    int count;                              // number of drops
+    int capacity;                           // count rounded up to a whole number of SIMD vectors (the padding drops are simulated but not drawn)
+    std::vector<float> x, y, z, vx, vy, vz; // position and velocity of each drop
+    bool vectorize = true;                  // use the SIMD kernel (false: scalar reference, for comparison)
+
+    RainParticles(int n, glm::vec3 fallVelocity, float height, float radius, ThreadPool &threads, uint64_t seed = randomSeed)
+        : count(n),
+          capacity((n + simd::width - 1) / simd::width * simd::width),
+          velocity(fallVelocity),
+          spawnHeight(height),
+          spawnRadius(radius),
+          pool(threads)
+    {
+        for (int chunk = 0; chunk * rainChunk < capacity; chunk++)
+            chunkRandom.emplace_back(seed, chunk);
+
+        // all drops start at the origin and respawn around the viewer on the first update
+        x.assign(capacity, 0.0f), y.assign(capacity, 0.0f), z.assign(capacity, 0.0f);
+        vx.assign(capacity, 0.0f), vy.assign(capacity, 0.0f), vz.assign(capacity, 0.0f);
+    }
+
+    //! Moves every drop by its velocity * dt and respawns the ones at or below minY around center. The positions are written to out as 3 arrays of capacity floats (x, then y, then z); out is only written to, so it can be a mapped vertex buffer.
+    void update(float dt, float minY, glm::vec3 center, float *out)
+    {
+        pool.parallelFor(0, chunkRandom.size(), 1, [&](int first, int last)
+                         {
+                             for (int chunk = first; chunk < last; chunk++)
+                                 updateChunk(chunk, dt, minY, center, out); });
+    }
+
+private:
+    glm::vec3 velocity;
+    float spawnHeight, spawnRadius;
+    ThreadPool &pool;
+    std::vector<Random> chunkRandom; // random stream of each chunk
+
+    //! Updates drops [chunk * rainChunk, (chunk + 1) * rainChunk), collecting the grounded ones, which are respawned together at the end.
+    void updateChunk(int chunk, float dt, float minY, glm::vec3 center, float *out)
+    {
+        int begin = chunk * rainChunk, end = std::min(begin + rainChunk, capacity);
+        float *outX = out, *outY = out + capacity, *outZ = out + 2 * capacity;
+
+        thread_local std::vector<int> grounded;
+        grounded.clear();
+
+        if (!vectorize)
+        {
+            for (int i = begin; i < end; i++)
+            {
+                x[i] += vx[i] * dt, y[i] += vy[i] * dt, z[i] += vz[i] * dt;
+                outX[i] = x[i], outY[i] = y[i], outZ[i] = z[i];
+
+                if (y[i] <= minY)
+                    grounded.push_back(i);
+            }
+        }
+        else
+        {
+            simd::floatv step = simd::set1(dt), ground = simd::set1(minY);
+
+            for (int i = begin; i < end; i += simd::width)
+            {
+                simd::floatv px = simd::fmadd(simd::load(&vx[i]), step, simd::load(&x[i]));
+                simd::floatv py = simd::fmadd(simd::load(&vy[i]), step, simd::load(&y[i]));
+                simd::floatv pz = simd::fmadd(simd::load(&vz[i]), step, simd::load(&z[i]));
+                simd::store(&x[i], px), simd::store(&y[i], py), simd::store(&z[i], pz);
+                simd::store(&outX[i], px), simd::store(&outY[i], py), simd::store(&outZ[i], pz);
+
+                // one bit per drop that reached the ground: rare (a drop lives for seconds)
+                int groundedMask = simd::moveMask(simd::lessEqual(py, ground));
+                for (; groundedMask; groundedMask &= groundedMask - 1)
+                    grounded.push_back(i + __builtin_ctz(groundedMask));
+            }
+        }
+
+        respawn(grounded, chunkRandom[chunk], center, out);
+    }
+
+    //! Places the given drops at random points of the spawn disc above center, with the fall velocity (random numbers generated in batches), and rewrites their output positions.
+    void respawn(const std::vector<int> &drops, Random &random, glm::vec3 center, float *out)
+    {
+        int n = drops.size();
+        if (n == 0)
+            return;
+
+        thread_local std::vector<float> offsets, angles, radii;
+        offsets.resize(n), angles.resize(n), radii.resize(n);
+        random.fillUniform(offsets.data(), n, 0.0f, 10.0f);       // random height above spawnHeight in range [0, 10]
+        random.fillDisc(angles.data(), radii.data(), n, spawnRadius); // random point of the spawn disc
+
+        for (int k = 0; k < n; k++)
+        {
+            int i = drops[k];
+            x[i] = center.x + radii[k] * std::cos(angles[k]);
+            y[i] = spawnHeight + offsets[k];
+            z[i] = center.z + radii[k] * std::sin(angles[k]);
+            vx[i] = velocity.x, vy[i] = velocity.y, vz[i] = velocity.z;
+
+            out[i] = x[i], out[capacity + i] = y[i], out[2 * capacity + i] = z[i];
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cmath>
+#include <cstdint>
+#include <ctime>
+
+uint64_t randomSeed = (uint64_t)std::time(NULL); // seed of all emitter random streams: different on each launch unless fixed (--seed <n>)
+
+// xoshiro128+ generator (Blackman and Vigna): 128 bits of state, a few adds / xors / shifts per number, no global state. Every (seed, stream) pair gives an independent sequence, so each thread or work chunk can own one and results do not depend on scheduling
+class Random
+{
+public:
+    Random(uint64_t seed = randomSeed, uint64_t stream = 0)
+    {
+        // state from splitmix64, which spreads nearby seeds / streams over the whole state space (and never yields the all-zero state in practice)
+        uint64_t x = seed ^ (stream * 0xD1B54A32D192ED03ull);
+        for (int i = 0; i < 4; i += 2)
+        {
+            uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            z ^= z >> 31;
+            state[i] = (uint32_t)z;
+            state[i + 1] = (uint32_t)(z >> 32);
+        }
+    }
+
+    uint32_t next()
+    {
+        uint32_t result = state[0] + state[3];
+        uint32_t t = state[1] << 9;
+
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = (state[3] << 11) | (state[3] >> 21);
+
+        return result;
+    }
+
+    //! Uniform in [0, 1) (the upper 24 bits, which are the best ones of xoshiro128+).
+    float uniform() { return (next() >> 8) * (1.0f / 16777216.0f); }
+
+    //! Uniform in [low, high).
+    float uniform(float low, float high) { return low + (high - low) * uniform(); }
+
+    //! Fills values[0, n) with numbers uniform in [low, high).
+    void fillUniform(float *values, int n, float low, float high)
+    {
+        for (int i = 0; i < n; i++)
+            values[i] = uniform(low, high);
+    }
+
+    //! Fills angles[0, n) and radii[0, n) with uniformly distributed points of a disc of the given radius in polar coordinates (sqrt of a uniform radius, so the density does not grow toward the center).
+    void fillDisc(float *angles, float *radii, int n, float radius)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            angles[i] = uniform(0.0f, 2.0f * (float)M_PI);
+            radii[i] = std::sqrt(uniform()) * radius;
+        }
+    }
+
+private:
+    uint32_t state[4];
+};
+
+#endif
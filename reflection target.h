@@ -0,0 +1,179 @@
+#ifndef REFLECTION_TARGET_H
+#define REFLECTION_TARGET_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// adaptive reflection settings: the reflection is rendered only over the part of the screen covered by the water, at a resolution scaled down (per axis) as far as needed to keep its GPU time within the budget
+float reflectionBudgetMs = 2.0f;            // GPU time allowed for the reflection pass (--reflection-budget <ms>; 0: always full resolution)
+const float reflectionMinScale = 0.25f;     // lowest resolution scale relative to the screen
+const float reflectionScaleStep = 1.0f / 16; // scales are quantized to this step, so the resolution does not change on every frame
+const float reflectionCostSmoothing = 0.1f; // weight of the latest measurement in the running GPU cost per pixel
+const float reflectionRectPadding = 0.05f;  // margin around the water on screen (NDC units), for the wave displacement and the filtering of the reflection lookup
+
+// part of the image of a camera covered by the water surface, from its outline clipped to the view frustum
+struct WaterCoverage
+{
+    float fraction = 0.0f;                                // covered fraction of the image, 0 – 1 (an upper bound: the terrain in front of the water is not taken into account)
+    glm::vec2 rectMin = glm::vec2(0.0f), rectMax = rectMin; // bounding rectangle of the water in the image, in 0 – 1 coordinates (padded)
+
+    bool visible() const { return fraction > 0.0f; }
+};
+
+//! Projects the square water surface (height level, from -halfSize to halfSize on the x and z axes) with the given view-projection matrix: the square is clipped against the 6 frustum planes in clip space (Sutherland-Hodgman), so that parts behind the camera are handled correctly, and the area and bounds of what remains are measured on screen.
+WaterCoverage waterScreenCoverage(const glm::mat4 &viewProjection, float level, float halfSize)
+{
+    std::vector<glm::vec4> polygon = {viewProjection * glm::vec4(-halfSize, level, -halfSize, 1.0f), viewProjection * glm::vec4(halfSize, level, -halfSize, 1.0f),
+                                      viewProjection * glm::vec4(halfSize, level, halfSize, 1.0f), viewProjection * glm::vec4(-halfSize, level, halfSize, 1.0f)};
+    std::vector<glm::vec4> clipped;
+
+    // clip-space planes w + x, w - x, w + y, w - y, w + z, w - z (each >= 0 inside)
+    for (int plane = 0; plane < 6 && !polygon.empty(); plane++)
+    {
+        int axis = plane / 2;
+        float sign = (plane % 2 == 0) ? 1.0f : -1.0f;
+        auto distance = [&](const glm::vec4 &v) { return v.w + sign * v[axis]; };
+
+        clipped.clear();
+        for (size_t i = 0; i < polygon.size(); i++)
+        {
+            const glm::vec4 &a = polygon[i], &b = polygon[(i + 1) % polygon.size()];
+            float da = distance(a), db = distance(b);
+            if (da >= 0.0f)
+                clipped.push_back(a);
+            if ((da >= 0.0f) != (db >= 0.0f))
+                clipped.push_back(a + (b - a) * (da / (da - db)));
+        }
+        polygon.swap(clipped);
+    }
+
+    WaterCoverage coverage;
+    if (polygon.size() < 3)
+        return coverage;
+
+    // screen area (shoelace formula; NDC spans 2 x 2) and bounds of the projected polygon
+    glm::vec2 ndcMin(1.0f), ndcMax(-1.0f);
+    float area = 0.0f;
+    for (size_t i = 0; i < polygon.size(); i++)
+    {
+        glm::vec2 a = glm::vec2(polygon[i]) / polygon[i].w;
+        glm::vec2 b = glm::vec2(polygon[(i + 1) % polygon.size()]) / polygon[(i + 1) % polygon.size()].w;
+        area += a.x * b.y - b.x * a.y;
+        ndcMin = glm::min(ndcMin, a);
+        ndcMax = glm::max(ndcMax, a);
+    }
+
+    coverage.fraction = std::min(std::abs(area) / 2.0f / 4.0f, 1.0f);
+    coverage.rectMin = glm::clamp((ndcMin - reflectionRectPadding) * 0.5f + 0.5f, 0.0f, 1.0f);
+    coverage.rectMax = glm::clamp((ndcMax + reflectionRectPadding) * 0.5f + 0.5f, 0.0f, 1.0f);
+    return coverage;
+}
+
+/*
+   Resolution control of the planar reflection, whose resolution changes from frame to frame: the frame graph allocates the reflection texture at the scale picked here
+   (from a pool sized in steps, so changing the scale or resizing the window mostly reuses the same storage), and the water samples it through the graph's lookup region.
+   Only the water's rectangle on screen is rendered (scissor), and the scale follows the measured GPU cost per rendered pixel.
+*/
+class ReflectionTarget
+{
+public:
+    float scale = 1.0f; // resolution relative to the screen, per axis
+
+    ReflectionTarget()
+    {
+        glGenQueries(2, beginQueries);
+        glGenQueries(2, endQueries);
+    }
+
+    //! Prepares the reflection pass for a screen of the given size, from the water's coverage of the screen and of the reflected camera's image (where the water looks up its reflection: the reflected camera keeps the world up vector, so its image is flipped vertically):
+    //! picks the scale. Returns false when the water is not on screen, and the reflection is not needed.
+    bool prepare(const WaterCoverage &screen, const WaterCoverage &coverage, int screenWidth, int screenHeight)
+    {
+        collectCost();
+        if (!screen.visible() || !coverage.visible())
+            return false;
+        rect = coverage;
+
+        // pixels of the water's rectangle at full resolution; the budget allows budget / cost per pixel of them
+        float rectPixels = std::max((coverage.rectMax.x - coverage.rectMin.x) * (coverage.rectMax.y - coverage.rectMin.y) * screenWidth * screenHeight, 1.0f);
+        float target = 1.0f;
+        if (reflectionBudgetMs > 0.0f && msPerPixel > 0.0f)
+            target = std::sqrt(reflectionBudgetMs / msPerPixel / rectPixels);
+        target = std::max(reflectionMinScale, std::min(1.0f, target));
+
+        // move to the quantized target only when it is a whole step away (avoids switching back and forth between two scales)
+        if (std::abs(target - scale) >= reflectionScaleStep)
+            scale = std::round(target / reflectionScaleStep) * reflectionScaleStep;
+        return true;
+    }
+
+    //! Starts the reflection pass in the bound framebuffer of the given size (the whole screen at the current scale): clears the water's rectangle, which stays the scissor region until end().
+    void begin(int width, int height)
+    {
+        int x0 = (int)std::floor(rect.rectMin.x * width), y0 = (int)std::floor(rect.rectMin.y * height);
+        int x1 = (int)std::ceil(rect.rectMax.x * width), y1 = (int)std::ceil(rect.rectMax.y * height);
+        renderedPixels = (x1 - x0) * (y1 - y0);
+
+        if (!pending[frame % 2])
+        {
+            glQueryCounter(beginQueries[frame % 2], GL_TIMESTAMP);
+            measuring = true;
+        }
+
+        glState.setEnabled(GL_SCISSOR_TEST, true);
+        glScissor(x0, y0, x1 - x0, y1 - y0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    void end()
+    {
+        if (measuring)
+        {
+            glQueryCounter(endQueries[frame % 2], GL_TIMESTAMP);
+            pending[frame % 2] = true;
+            pendingPixels[frame % 2] = renderedPixels;
+            measuring = false;
+        }
+        frame++;
+        glState.setEnabled(GL_SCISSOR_TEST, false);
+    }
+
+private:
+    WaterCoverage rect; // water in the reflected camera's image, from prepare()
+    float msPerPixel = 0.0f; // running GPU cost per rendered pixel (0: not measured yet)
+
+    // GPU time of the pass from timestamps at its start and end (as in the profiler: timestamps do not conflict with the other timer queries), double-buffered and read one frame or more later only if available (never waited for)
+    unsigned int beginQueries[2], endQueries[2];
+    bool pending[2] = {false, false};
+    int pendingPixels[2] = {0, 0};
+    int renderedPixels = 0, frame = 0;
+    bool measuring = false;
+
+    //! Adds the GPU times that are available to the running cost per pixel.
+    void collectCost()
+    {
+        for (int buffer = 0; buffer < 2; buffer++)
+        {
+            if (!pending[buffer])
+                continue;
+
+            GLint available = 0;
+            glGetQueryObjectiv(endQueries[buffer], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+
+            GLuint64 begin, end;
+            glGetQueryObjectui64v(beginQueries[buffer], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(endQueries[buffer], GL_QUERY_RESULT, &end);
+            pending[buffer] = false;
+
+            float cost = (end - begin) * 1e-6f / std::max(pendingPixels[buffer], 1);
+            msPerPixel = msPerPixel > 0.0f ? msPerPixel + reflectionCostSmoothing * (cost - msPerPixel) : cost;
+        }
+    }
+};
+
+#endif
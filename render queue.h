@@ -0,0 +1,106 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <vector>
+#include <glm/glm.hpp>
+
+// render queue settings
+const float drawDepthRange = 100.0f; // distances of the draws are quantized over this range (the far plane of the cameras); farther ones share the last step
+const int drawDepthBits = 10;        // ~0.1 world units per step: draws closer than that are ordered by state instead
+
+// passes in the order they render; the draws of a pass are executed together (by the code that sets up its framebuffer and camera)
+enum RenderPass
+{
+    REFLECTION_PASS,
+    MAIN_PASS
+};
+
+// groups of draws inside a pass, in the order they render
+enum RenderLayer
+{
+    OPAQUE_LAYER,     // front to back, so that the depth test rejects hidden fragments before they are shaded
+    SKY_LAYER,        // after the opaque geometry: its depth is the far plane, so it is only shaded where nothing else covers the screen
+    TRANSPARENT_LAYER // back to front, for blending (drawn over the depth of the opaque geometry without writing it)
+};
+
+//! Distance from the point to the axis-aligned box (0 inside it), the depth used to order the draws of an object.
+float boxDistance(const glm::vec3 &point, const glm::vec3 &boxMin, const glm::vec3 &boxMax)
+{
+    return glm::length(point - glm::clamp(point, boxMin, boxMax));
+}
+
+/*
+   Queue of the draws of a frame: entities submit draw packets (a function issuing their draw calls) with a 64-bit sort key, the queue sorts the keys once and executes the packets of each pass and layer in key order.
+   Key layout, from the most significant bit: pass (4 bits) | layer (2) | depth (drawDepthBits) | program (16) | texture set (16) | submission index (the rest).
+   Opaque draws are ordered by increasing depth, and those at the same depth by program and textures, so that the render state cache skips the repeated bindings;
+   transparent draws are ordered by decreasing depth only (their state must not reorder blending), then in submission order; the sky has a single draw.
+   The keys hold the index of their packet, so sorting them sorts the queue without moving the packets.
+*/
+class RenderQueue
+{
+public:
+    //! Adds a draw: program and textures are the GL names of its shader program and main texture (state it shares with other draws), depth its distance from the camera of the pass.
+    void submit(RenderPass pass, RenderLayer layer, unsigned int program, unsigned int textures, float depth, std::function<void()> draw)
+    {
+        // the packet index has to fit in the low bits of the key (beyond them it would overwrite the texture set, and execute() would run the wrong packets)
+        if (packets.size() > indexMask)
+        {
+            if (!overflowReported)
+                std::cout << "Render queue: more than " << indexMask + 1 << " draws in a frame, the rest are dropped" << std::endl;
+            overflowReported = true;
+            return;
+        }
+
+        const int depthShift = 64 - 6 - drawDepthBits;
+        uint64_t depthStep = (uint64_t)(std::min(std::max(depth / drawDepthRange, 0.0f), 1.0f) * ((1 << drawDepthBits) - 1));
+        if (layer == TRANSPARENT_LAYER)
+            depthStep = ((1 << drawDepthBits) - 1) - depthStep, program = textures = 0;
+        else if (layer == SKY_LAYER)
+            depthStep = 0;
+
+        uint64_t key = (uint64_t)pass << 60 | (uint64_t)layer << 58 | depthStep << depthShift | (uint64_t)(program & 0xFFFF) << (depthShift - 16) | (uint64_t)(textures & 0xFFFF) << (depthShift - 32);
+        keys.push_back(key | packets.size());
+        packets.push_back(std::move(draw));
+    }
+
+    //! Sorts the draws submitted since the last clear().
+    void sort()
+    {
+        std::sort(keys.begin(), keys.end());
+    }
+
+    //! Executes the sorted draws of a layer of a pass.
+    void execute(RenderPass pass, RenderLayer layer)
+    {
+        uint64_t first = (uint64_t)pass << 60 | (uint64_t)layer << 58, last = first | (((uint64_t)1 << 58) - 1);
+        for (auto key = std::lower_bound(keys.begin(), keys.end(), first); key != keys.end() && *key <= last; ++key)
+            packets[*key & indexMask]();
+    }
+
+    //! Executes all the sorted draws of a pass.
+    void execute(RenderPass pass)
+    {
+        for (RenderLayer layer : {OPAQUE_LAYER, SKY_LAYER, TRANSPARENT_LAYER})
+            execute(pass, layer);
+    }
+
+    //! Removes the draws of the frame (the storage is kept for the next one).
+    void clear()
+    {
+        keys.clear();
+        packets.clear();
+    }
+
+private:
+    static const uint64_t indexMask = ((uint64_t)1 << (64 - 6 - drawDepthBits - 32)) - 1;
+
+    std::vector<uint64_t> keys;
+    std::vector<std::function<void()>> packets;
+    bool overflowReported = false;
+};
+
+#endif
@@ -0,0 +1,202 @@
+#ifndef RENDER_STATE_H
+#define RENDER_STATE_H
+
+#include <iostream>
+#include <glad/glad.h>
+
+bool reportStateChanges = false; // print the GL state calls issued and skipped per frame every stateReportFrames frames (--state-stats)
+const int stateReportFrames = 300;
+const int maxTextureUnits = 8; // texture units tracked (the shaders use units 0 – 5)
+
+/*
+   Cache of the OpenGL binding and fixed-function state: every entity changes the program, vertex array, textures, framebuffers, viewport and depth / blend state through it,
+   and a call that would set the value already current is skipped (the driver validates state on every call, even a redundant one). Since draws no longer reset their bindings to 0,
+   nothing may change this state with a direct gl* call behind the cache's back; state created by other calls (e.g. the element buffer stored in a bound vertex array) is not affected.
+   Buffer bindings (GL_ARRAY_BUFFER, uniform and feedback buffers) are not cached: they are only bound when their contents are updated.
+*/
+class RenderState
+{
+public:
+    void useProgram(unsigned int program)
+    {
+        if (count(program == current.program))
+            return;
+        glUseProgram(program);
+        current.program = program;
+    }
+
+    void bindVertexArray(unsigned int vao)
+    {
+        if (count(vao == current.vertexArray))
+            return;
+        glBindVertexArray(vao);
+        current.vertexArray = vao;
+    }
+
+    //! Binds the texture to the given unit (making the unit active only if the binding changes).
+    void bindTexture(int unit, GLenum target, unsigned int texture)
+    {
+        TextureBinding &binding = current.textures[unit];
+        if (count(binding.target == target && binding.texture == texture))
+            return;
+        activeTexture(unit);
+        glBindTexture(target, texture);
+        binding = {target, texture};
+    }
+
+    //! Binds a texture to the active unit, for creating or updating it (the binding stays cached like any other).
+    void bindTexture(GLenum target, unsigned int texture)
+    {
+        bindTexture(current.activeUnit, target, texture);
+    }
+
+    //! GL_FRAMEBUFFER sets both the draw and the read framebuffer.
+    void bindFramebuffer(GLenum target, unsigned int framebuffer)
+    {
+        bool draw = target != GL_READ_FRAMEBUFFER, read = target != GL_DRAW_FRAMEBUFFER;
+        if (count((!draw || current.drawFramebuffer == framebuffer) && (!read || current.readFramebuffer == framebuffer)))
+            return;
+        glBindFramebuffer(target, framebuffer);
+        if (draw)
+            current.drawFramebuffer = framebuffer;
+        if (read)
+            current.readFramebuffer = framebuffer;
+    }
+
+    void viewport(int x, int y, int width, int height)
+    {
+        int *v = current.viewport;
+        if (count(v[0] == x && v[1] == y && v[2] == width && v[3] == height))
+            return;
+        glViewport(x, y, width, height);
+        v[0] = x, v[1] = y, v[2] = width, v[3] = height;
+    }
+
+    //! Enables or disables a capability; GL_DEPTH_TEST, GL_BLEND, GL_SCISSOR_TEST and GL_RASTERIZER_DISCARD are cached, others always issued.
+    void setEnabled(GLenum capability, bool enabled)
+    {
+        bool *state = capabilityState(capability);
+        if (state && count(*state == enabled))
+            return;
+        enabled ? glEnable(capability) : glDisable(capability);
+        if (state)
+            *state = enabled;
+    }
+
+    void depthMask(bool write)
+    {
+        if (count(current.depthWrite == write))
+            return;
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+        current.depthWrite = write;
+    }
+
+    void depthFunc(GLenum func)
+    {
+        if (count(current.depthFunc == func))
+            return;
+        glDepthFunc(func);
+        current.depthFunc = func;
+    }
+
+    void blendFunc(GLenum source, GLenum destination)
+    {
+        if (count(current.blendSource == source && current.blendDestination == destination))
+            return;
+        glBlendFunc(source, destination);
+        current.blendSource = source, current.blendDestination = destination;
+    }
+
+    //! Forgets the bindings of a texture about to be deleted (deleting it binds 0 in its place, and a new texture may get its name).
+    void forgetTexture(unsigned int texture)
+    {
+        for (TextureBinding &binding : current.textures)
+            if (binding.texture == texture)
+                binding.texture = 0;
+    }
+
+    //! Same for a framebuffer about to be deleted.
+    void forgetFramebuffer(unsigned int framebuffer)
+    {
+        if (current.drawFramebuffer == framebuffer)
+            current.drawFramebuffer = 0;
+        if (current.readFramebuffer == framebuffer)
+            current.readFramebuffer = 0;
+    }
+
+    // current values, for code that restores them (instead of querying the driver with glGet, which may stall it)
+    unsigned int drawFramebuffer() const { return current.drawFramebuffer; }
+    const int *currentViewport() const { return current.viewport; }
+
+    //! Ends a frame; prints the issued and skipped calls every stateReportFrames frames.
+    void endFrame()
+    {
+        if (!reportStateChanges || ++frame % stateReportFrames != 0)
+            return;
+
+        long total = issued + skipped;
+        std::cout << "Render state: " << issued / stateReportFrames << " GL state calls per frame, " << skipped / stateReportFrames << " redundant ones skipped ("
+                  << (total > 0 ? 100 * skipped / total : 0) << "%)" << std::endl;
+        issued = skipped = 0;
+    }
+
+private:
+    struct TextureBinding
+    {
+        GLenum target = GL_NONE;
+        unsigned int texture = 0;
+    };
+
+    // initial values of a new context
+    struct
+    {
+        unsigned int program = 0, vertexArray = 0;
+        unsigned int drawFramebuffer = 0, readFramebuffer = 0;
+        int activeUnit = 0;
+        TextureBinding textures[maxTextureUnits];
+        int viewport[4] = {-1, -1, -1, -1}; // unknown until set (the initial viewport is the size of the window)
+        bool depthTest = false, blend = false, scissorTest = false, rasterizerDiscard = false;
+        bool depthWrite = true;
+        GLenum depthFunc = GL_LESS;
+        GLenum blendSource = GL_ONE, blendDestination = GL_ZERO;
+    } current;
+
+    long issued = 0, skipped = 0;
+    int frame = 0;
+
+    //! Counts the call as skipped if redundant, or as issued; returns redundant.
+    bool count(bool redundant)
+    {
+        (redundant ? skipped : issued)++;
+        return redundant;
+    }
+
+    void activeTexture(int unit)
+    {
+        if (count(unit == current.activeUnit))
+            return;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        current.activeUnit = unit;
+    }
+
+    bool *capabilityState(GLenum capability)
+    {
+        switch (capability)
+        {
+        case GL_DEPTH_TEST:
+            return &current.depthTest;
+        case GL_BLEND:
+            return &current.blend;
+        case GL_SCISSOR_TEST:
+            return &current.scissorTest;
+        case GL_RASTERIZER_DISCARD:
+            return &current.rasterizerDiscard;
+        default:
+            return NULL;
+        }
+    }
+};
+
+RenderState glState; // the render state of the (single) OpenGL context
+
+#endif
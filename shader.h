@@ -3,7 +3,112 @@
 
 #include <fstream>              // for reading files
 #include <sstream>              // for handling string streams
+#include <algorithm>            // for binary search in the uniform table
+#include <cstring>              // for strcmp
+#include <iostream>
+#include <vector>
+#include <chrono>               // for the shader startup time
+#include <cstdint>
+#include <cstdio>               // for snprintf
+#include <filesystem>           // for creating the program binary cache directory
 #include <glm/gtc/type_ptr.hpp> // for matrix conversion to raw pointers (OpenGL compatibility with GLM)
+#include "render state.h"       // cached program binding
+
+// program binary cache
+bool useShaderCache = true;                   // load linked programs from shaderCacheDir instead of compiling them (--no-shader-cache)
+const std::string shaderCacheDir = "shader_cache"; // one file per program, named by the hash of its sources and of the driver
+
+// startup cost of the programs created so far (reported by main)
+struct
+{
+    int programs = 0;     // programs created
+    int fromCache = 0;    // of which loaded from a cached binary
+    double seconds = 0.0; // total time spent in the Shader constructor
+} shaderStats;
+
+// fixed binding points of the uniform blocks shared by all programs (the buffers are bound by UniformBuffers)
+enum UniformBlockBinding
+{
+    CAMERA_BINDING,           // camera of the current pass
+    REFLECTED_CAMERA_BINDING, // reflected camera (water)
+    SCENE_BINDING,            // light and fog
+    SHADOWS_BINDING           // shadow cascades
+};
+
+const struct
+{
+    const char *name;
+    UniformBlockBinding binding;
+} uniformBlockBindings[] = {{"Camera", CAMERA_BINDING}, {"ReflectedCamera", REFLECTED_CAMERA_BINDING}, {"Scene", SCENE_BINDING}, {"Shadows", SHADOWS_BINDING}};
+
+// value types of uniform variables: which GLSL types they can be assigned to, and the glUniform call for them
+template <typename T>
+struct UniformType;
+
+template <>
+struct UniformType<int>
+{
+    static bool accepts(GLenum type) { return type == GL_INT || (type >= GL_SAMPLER_1D && type <= GL_SAMPLER_2D_SHADOW) || type == GL_SAMPLER_2D_ARRAY || type == GL_SAMPLER_2D_ARRAY_SHADOW; } // integers and texture units of samplers
+    static void set(int location, int value) { glUniform1i(location, value); }
+};
+
+template <>
+struct UniformType<bool>
+{
+    static bool accepts(GLenum type) { return type == GL_BOOL; }
+    static void set(int location, bool value) { glUniform1i(location, (int)value); }
+};
+
+template <>
+struct UniformType<unsigned int>
+{
+    static bool accepts(GLenum type) { return type == GL_UNSIGNED_INT; }
+    static void set(int location, unsigned int value) { glUniform1ui(location, value); }
+};
+
+template <>
+struct UniformType<float>
+{
+    static bool accepts(GLenum type) { return type == GL_FLOAT; }
+    static void set(int location, float value) { glUniform1f(location, value); }
+};
+
+template <>
+struct UniformType<glm::vec2>
+{
+    static bool accepts(GLenum type) { return type == GL_FLOAT_VEC2; }
+    static void set(int location, const glm::vec2 &value) { glUniform2fv(location, 1, glm::value_ptr(value)); }
+};
+
+template <>
+struct UniformType<glm::vec3>
+{
+    static bool accepts(GLenum type) { return type == GL_FLOAT_VEC3; }
+    static void set(int location, const glm::vec3 &value) { glUniform3fv(location, 1, glm::value_ptr(value)); }
+};
+
+template <>
+struct UniformType<glm::vec4>
+{
+    static bool accepts(GLenum type) { return type == GL_FLOAT_VEC4; }
+    static void set(int location, const glm::vec4 &value) { glUniform4fv(location, 1, glm::value_ptr(value)); }
+};
+
+template <>
+struct UniformType<glm::mat4>
+{
+    static bool accepts(GLenum type) { return type == GL_FLOAT_MAT4; }
+    static void set(int location, const glm::mat4 &value) { glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value)); }
+};
+
+// uniform location resolved once (Shader::uniform), for per-frame code: setting it does no name lookup; applies to the shader program in use
+template <typename T>
+struct UniformHandle
+{
+    int location = -1; // -1 (unknown or optimized-out uniform) is ignored by OpenGL, same as a failed glGetUniformLocation
+
+    void set(const T &value) const { UniformType<T>::set(location, value); }
+};
 
 class Shader
 {
@@ -11,18 +116,23 @@ public:
     unsigned int shaderProgram;
 
     // constructor that generates the graphics pipeline on the fly when the class instance is initialized
-    Shader(const char *vertexPath, const char *fragmentPath)
+    // (fragmentPath NULL: vertex-only program, whose feedbackVaryings outputs are captured interleaved with transform feedback)
+    Shader(const char *vertexPath, const char *fragmentPath, const std::vector<const char *> &feedbackVaryings = {})
     {
+        auto start = std::chrono::steady_clock::now();
+
         // 1. retrieve the vertex/fragment shader source code from filePath
         std::string vertexCode, fragmentCode;
         std::ifstream vShaderFile, fShaderFile;
         std::stringstream vShaderStream, fShaderStream;
 
         vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
+        if (fragmentPath)
+            fShaderFile.open(fragmentPath);
         // read file's buffer contents into streams
         vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
+        if (fragmentPath)
+            fShaderStream << fShaderFile.rdbuf();
         // close file handlers
         vShaderFile.close();
         fShaderFile.close();
@@ -33,61 +143,259 @@ public:
         const char *vertexShaderSource = vertexCode.c_str();
         const char *fragmentShaderSource = fragmentCode.c_str();
 
-        // 2. compile shaders
-        unsigned int vertexShader;
-        vertexShader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-        glCompileShader(vertexShader);
+        // 2. load the linked program from the cache, or compile and link it (and cache it)
+        std::string cachePath;
+        if (useShaderCache && GLAD_GL_ARB_get_program_binary)
+        {
+            int formats = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+            if (formats > 0)
+                cachePath = shaderCacheDir + "/" + cacheKey(vertexCode, fragmentCode, feedbackVaryings) + ".bin";
+        }
 
-        unsigned int fragmentShader;
-        fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-        glCompileShader(fragmentShader);
+        bool cached = !cachePath.empty() && loadBinary(cachePath);
+        if (!cached)
+        {
+            compile(vertexShaderSource, fragmentPath ? fragmentShaderSource : NULL, feedbackVaryings, !cachePath.empty());
 
-        shaderProgram = glCreateProgram();
-        glAttachShader(shaderProgram, vertexShader);
-        glAttachShader(shaderProgram, fragmentShader);
-        glLinkProgram(shaderProgram);
+            int linked = 0;
+            glGetProgramiv(shaderProgram, GL_LINK_STATUS, &linked);
+            if (linked && !cachePath.empty())
+                saveBinary(cachePath);
+        }
 
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
+        // connect the shared uniform blocks the program declares to their binding points
+        for (const auto &block : uniformBlockBindings)
+        {
+            unsigned int index = glGetUniformBlockIndex(shaderProgram, block.name);
+            if (index != GL_INVALID_INDEX)
+                glUniformBlockBinding(shaderProgram, index, block.binding);
+        }
+
+        reflectUniforms();
+
+        shaderStats.programs++;
+        shaderStats.fromCache += cached;
+        shaderStats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
     }
 
     // define a class function that activates shader program
     void use()
     {
-        glUseProgram(shaderProgram);
+        glState.useProgram(shaderProgram);
+    }
+
+    //! Returns the location of a uniform variable from the table built at link time (-1 if the program has no such active uniform).
+    int location(const char *name) const
+    {
+        auto it = std::lower_bound(uniforms.begin(), uniforms.end(), name, [](const UniformInfo &info, const char *key)
+                                   { return std::strcmp(info.name.c_str(), key) < 0; });
+
+        return (it != uniforms.end() && std::strcmp(it->name.c_str(), name) == 0) ? it->location : -1;
     }
 
-    // utility functions to set uniform variables
-    void setInt(const std::string &name, int value) const
+    //! Resolves a typed handle to a uniform variable; reports a mismatch between T and the GLSL type.
+    template <typename T>
+    UniformHandle<T> uniform(const char *name) const
     {
-        glUniform1i(glGetUniformLocation(shaderProgram, name.c_str()), value);
+        UniformHandle<T> handle;
+        handle.location = location(name);
+
+        for (const UniformInfo &info : uniforms)
+            if (info.location == handle.location && handle.location != -1 && !UniformType<T>::accepts(info.type))
+            {
+                std::cout << "Shader: uniform " << name << " has GLSL type 0x" << std::hex << info.type << std::dec << ", which does not match its handle" << std::endl;
+                break;
+            }
+
+        return handle;
     }
 
-    void setFloat(const std::string &name, float value) const
+    // utility functions to set uniform variables (table lookup by name; prefer UniformHandle in per-frame code)
+    void setInt(const char *name, int value) const
     {
-        glUniform1f(glGetUniformLocation(shaderProgram, name.c_str()), value);
+        glUniform1i(location(name), value);
     }
 
-    void setBool(const std::string &name, bool value) const
+    void setFloat(const char *name, float value) const
     {
-        glUniform1i(glGetUniformLocation(shaderProgram, name.c_str()), (int)value);
+        glUniform1f(location(name), value);
     }
 
-    void setVec3(const std::string &name, glm::vec3 value) const
+    void setBool(const char *name, bool value) const
     {
-        glUniform3fv(glGetUniformLocation(shaderProgram, name.c_str()), 1, glm::value_ptr(value));
+        glUniform1i(location(name), (int)value);
     }
 
-    void setVec4(const std::string &name, glm::vec4 value) const
+    void setVec2(const char *name, glm::vec2 value) const
     {
-        glUniform4fv(glGetUniformLocation(shaderProgram, name.c_str()), 1, glm::value_ptr(value));
+        glUniform2fv(location(name), 1, glm::value_ptr(value));
     }
 
-    void setMat4(const std::string &name, glm::mat4 value) const
+    void setVec3(const char *name, glm::vec3 value) const
+    {
+        glUniform3fv(location(name), 1, glm::value_ptr(value));
+    }
+
+    void setVec4(const char *name, glm::vec4 value) const
+    {
+        glUniform4fv(location(name), 1, glm::value_ptr(value));
+    }
+
+    void setMat4(const char *name, glm::mat4 value) const
+    {
+        glUniformMatrix4fv(location(name), 1, GL_FALSE, glm::value_ptr(value));
+    }
+
+private:
+    struct UniformInfo
+    {
+        std::string name;
+        int location;
+        GLenum type;
+    };
+    std::vector<UniformInfo> uniforms; // active uniforms of the linked program, sorted by name
+
+    //! Compiles the stages (no fragment shader if fragmentShaderSource is NULL) and links them into a new program; retrievable: keep the binary available for glGetProgramBinary.
+    void compile(const char *vertexShaderSource, const char *fragmentShaderSource, const std::vector<const char *> &feedbackVaryings, bool retrievable)
     {
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+        unsigned int vertexShader;
+        vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
+        glCompileShader(vertexShader);
+
+        shaderProgram = glCreateProgram();
+        if (retrievable)
+            glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glAttachShader(shaderProgram, vertexShader);
+
+        unsigned int fragmentShader = 0;
+        if (fragmentShaderSource)
+        {
+            fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+            glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
+            glCompileShader(fragmentShader);
+            glAttachShader(shaderProgram, fragmentShader);
+        }
+
+        // the captured outputs are part of the link
+        if (!feedbackVaryings.empty())
+            glTransformFeedbackVaryings(shaderProgram, feedbackVaryings.size(), feedbackVaryings.data(), GL_INTERLEAVED_ATTRIBS);
+
+        glLinkProgram(shaderProgram);
+
+        glDeleteShader(vertexShader);
+        if (fragmentShader)
+            glDeleteShader(fragmentShader);
+    }
+
+    //! Cache file name: 64-bit FNV-1a hash of the sources, the captured varyings and the driver identification (a binary is only valid for the driver that produced it).
+    static std::string cacheKey(const std::string &vertexCode, const std::string &fragmentCode, const std::vector<const char *> &feedbackVaryings)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto add = [&](const char *text)
+        {
+            for (const char *c = text ? text : ""; ; c++)
+            {
+                hash = (hash ^ (unsigned char)*c) * 1099511628211ull;
+                if (!*c)
+                    break; // the terminating 0 is hashed too, as a separator
+            }
+        };
+
+        add((const char *)glGetString(GL_VENDOR));
+        add((const char *)glGetString(GL_RENDERER));
+        add((const char *)glGetString(GL_VERSION));
+        add(vertexCode.c_str());
+        add(fragmentCode.c_str());
+        for (const char *varying : feedbackVaryings)
+            add(varying);
+
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+        return name;
+    }
+
+    //! Creates the program from a cached binary; false if there is none or the driver rejects it (e.g. after a driver update with the same version string).
+    bool loadBinary(const std::string &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        GLenum format;
+        if (!file.read((char *)&format, sizeof(format)))
+            return false;
+        std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        shaderProgram = glCreateProgram();
+        glProgramBinary(shaderProgram, format, binary.data(), binary.size());
+
+        int linked = 0;
+        glGetProgramiv(shaderProgram, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            glDeleteProgram(shaderProgram);
+            return false;
+        }
+        return true;
+    }
+
+    //! Writes the binary of the linked program (format, then data) to the cache.
+    void saveBinary(const std::string &path) const
+    {
+        int length = 0;
+        glGetProgramiv(shaderProgram, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+
+        std::vector<char> binary(length);
+        GLenum format;
+        glGetProgramBinary(shaderProgram, length, &length, &format, binary.data());
+
+        std::error_code error;
+        std::filesystem::create_directories(shaderCacheDir, error);
+        std::ofstream file(path, std::ios::binary);
+        file.write((const char *)&format, sizeof(format));
+        file.write(binary.data(), length);
+    }
+
+    //! Builds the uniform table from the active uniforms of the program (glGetActiveUniform), instead of calling glGetUniformLocation on every set. Arrays are registered by their base name and by each element, e.g. "ranges", "ranges[0]", "ranges[1]".
+    void reflectUniforms()
+    {
+        int count = 0, maxLength = 0;
+        glGetProgramiv(shaderProgram, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(shaderProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<char> buffer(maxLength + 1);
+
+        for (int i = 0; i < count; i++)
+        {
+            int length = 0, size = 0;
+            GLenum type;
+            glGetActiveUniform(shaderProgram, i, buffer.size(), &length, &size, &type, buffer.data());
+            std::string name(buffer.data(), length);
+
+            // uniforms in uniform blocks have no location
+            int location = glGetUniformLocation(shaderProgram, name.c_str());
+            if (location == -1)
+                continue;
+
+            // arrays are reported as "name[0]"
+            size_t bracket = name.find('[');
+            if (bracket == std::string::npos)
+            {
+                uniforms.push_back({name, location, type});
+                continue;
+            }
+
+            std::string base = name.substr(0, bracket);
+            uniforms.push_back({base, location, type});
+            for (int element = 0; element < size; element++)
+            {
+                std::string elementName = base + "[" + std::to_string(element) + "]";
+                uniforms.push_back({elementName, glGetUniformLocation(shaderProgram, elementName.c_str()), type});
+            }
+        }
+
+        std::sort(uniforms.begin(), uniforms.end(), [](const UniformInfo &a, const UniformInfo &b)
+                  { return a.name < b.name; });
     }
 };
 
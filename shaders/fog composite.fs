@@ -0,0 +1,12 @@
+#version 330 core
+
+out vec4 FragColor;
+
+in vec2 TexCoord;
+
+uniform sampler2D fogLayer; // premultiplied alpha, blended with (1, 1 - alpha)
+
+void main()
+{
+    FragColor = texture(fogLayer, TexCoord); // bilinear upsampling of the reduced-resolution layer
+}
@@ -2,11 +2,44 @@
 
 out vec4 FragColor;
 
-uniform vec4 fogColor;
+layout (std140) uniform Camera // camera of the current pass (binding point shared by all programs)
+{
+    mat4 view;
+    mat4 projection;
+    vec4 position;
+} camera;
+
+layout (std140) uniform Scene // light and fog
+{
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 fogColor;
+} scene;
 uniform sampler2D particleTexture;
- 
+uniform sampler2D sceneDepth; // scene depth at the resolution of the fog layer
+uniform bool soft;            // soft particle into the fog layer (premultiplied alpha), otherwise straight alpha into the scene
+uniform float softness;
+
+// view depth of a window-space depth value (inverse of the perspective projection)
+float linearDepth(float depth)
+{
+    return camera.projection[3][2] / (depth * 2.0 - 1.0 + camera.projection[2][2]);
+}
+
 void main()
 {
     float mask = texture(particleTexture, gl_PointCoord).r;
-    FragColor = vec4(fogColor.rgb, mask * fogColor.a);
+    float alpha = mask * scene.fogColor.a;
+
+    if (!soft)
+    {
+        FragColor = vec4(scene.fogColor.rgb, alpha);
+        return;
+    }
+
+    // fade out where the sprite approaches the scene behind it (and hide it where it is behind the scene), instead of a hard intersection line
+    float sceneDistance = linearDepth(texelFetch(sceneDepth, ivec2(gl_FragCoord.xy), 0).r);
+    alpha *= clamp((sceneDistance - linearDepth(gl_FragCoord.z)) / softness, 0.0, 1.0);
+
+    FragColor = vec4(scene.fogColor.rgb * alpha, alpha);
 }
\ No newline at end of file
@@ -1,10 +1,17 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140) uniform Camera // camera of the current pass (binding point shared by all programs)
+{
+    mat4 view;
+    mat4 projection;
+    vec4 position;
+} camera;
+
+uniform float pointSize; // sprite size in pixels of the target
 
 void main()
 {
-    gl_Position = projection * view * vec4(aPos, 1.0);
+    gl_Position = camera.projection * camera.view * vec4(aPos, 1.0);
+    gl_PointSize = pointSize;
 }
\ No newline at end of file
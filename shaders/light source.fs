@@ -2,9 +2,14 @@
 
 out vec4 FragColor;
 
-uniform vec3 lightColor;
+layout (std140) uniform Scene // light and fog
+{
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 fogColor;
+} scene;
 
 void main()
 {
-    FragColor = vec4(lightColor, 1.0);
+    FragColor = vec4(scene.lightColor.rgb, 1.0);
 }
\ No newline at end of file
@@ -1,11 +1,15 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 projection;
-uniform mat4 view;
+layout (std140) uniform Camera // camera of the current pass (binding point shared by all programs)
+{
+    mat4 view;
+    mat4 projection;
+    vec4 position;
+} camera;
 uniform mat4 model;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = camera.projection * camera.view * model * vec4(aPos, 1.0);
 } 
\ No newline at end of file
@@ -0,0 +1,48 @@
+#version 330 core
+layout (location = 0) in vec3 aPos; // drop position of the previous frame
+
+out vec3 outPosition; // captured with transform feedback into the other buffer
+
+uniform float dt;
+uniform vec3 velocity;    // fall velocity (the same for all drops)
+uniform float minY;       // drops at or below respawn
+uniform vec3 center;      // camera position: drops respawn on a disc above it
+uniform float spawnHeight;
+uniform float spawnRadius;
+uniform uint seed;        // different every frame
+
+// integer hash (lowbias32 by C. Wellons): good avalanche with a few multiplications, no state kept between frames
+uint hash(uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// uniform random number in [0, 1) from the next hash of state
+float random(inout uint state)
+{
+    state = hash(state);
+    return float(state >> 8) * (1.0 / 16777216.0);
+}
+
+void main()
+{
+    vec3 position = aPos + velocity * dt;
+
+    // respawn the drop if it reached the ground (same distribution as RainParticles::respawn)
+    if (position.y <= minY)
+    {
+        uint state = hash(uint(gl_VertexID) ^ hash(seed));
+        float randomOffset = random(state) * 10.0;                     // random in range [0, 10]
+        float randomAngle = random(state) * 6.28318531;                 // random in range [0, 2π] (in radians)
+        float randomRadius = sqrt(random(state)) * spawnRadius;         // random in range [0, spawnRadius] with bias toward center via sqrt
+
+        position = vec3(center.x + randomRadius * cos(randomAngle), spawnHeight + randomOffset, center.z + randomRadius * sin(randomAngle));
+    }
+
+    outPosition = position;
+}
@@ -1,15 +1,21 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
+layout (location = 0) in float aX; // drop position, one attribute per array of the particle store
+layout (location = 1) in float aY;
+layout (location = 2) in float aZ;
 
-uniform mat4 view;
-uniform mat4 projection;
-uniform vec3 cameraPos;
+layout (std140) uniform Camera // camera of the current pass (binding point shared by all programs)
+{
+    mat4 view;
+    mat4 projection;
+    vec4 position;
+} camera;
 
 void main()
 {
-    float dist = distance(aPos, cameraPos);
+    vec3 aPos = vec3(aX, aY, aZ);
+    float dist = distance(aPos, camera.position.xyz);
     float size = clamp(100.0 / dist, 2.0, 500.0); // vary raindrop size based on distance from camera, clamped to keep it in range [2, 500]
 
-    gl_Position = projection * view * vec4(aPos, 1.0);
+    gl_Position = camera.projection * camera.view * vec4(aPos, 1.0);
     gl_PointSize = size;
 }
\ No newline at end of file
@@ -2,9 +2,14 @@
 layout (location = 0) in vec3 aPos;
 
 uniform mat4 model;
-uniform mat4 lightSpaceMatrix;
+layout (std140) uniform Camera // light camera of the cascade being rendered
+{
+    mat4 view;
+    mat4 projection;
+    vec4 position;
+} camera;
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+    gl_Position = camera.projection * camera.view * model * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -3,13 +3,17 @@ layout (location = 0) in vec3 aPos;
 
 out vec3 TexCoord;
 
-uniform mat4 projection;
-uniform mat4 view;
+layout (std140) uniform Camera // camera of the current pass (binding point shared by all programs)
+{
+    mat4 view;
+    mat4 projection;
+    vec4 position;
+} camera;
 uniform mat4 model;
 
 void main()
 {
     TexCoord = aPos; // bind to cube vertices (texture coordinate is just a position on the surface of the unit cube)
-    vec4 pos = projection * view * model * vec4(aPos, 1.0);
+    vec4 pos = camera.projection * mat4(mat3(camera.view)) * model * vec4(aPos, 1.0); // remove translation from the view matrix so the skybox moves with the camera, creating the illusion of an infinitely distant environment
     gl_Position = pos.xyww; // a trick to force z = w so that after perspective division, depth is always 1.0, which is the max depth value at the far plane
 }
\ No newline at end of file
@@ -0,0 +1,56 @@
+#version 330 core
+layout (location = 0) in vec2 aGrid; // integer vertex coordinates inside the patch, in range [0, gridDim]
+layout (location = 3) in vec4 aNode; // per-instance quadtree node: model-space origin (x, z), size, LOD level
+
+out vec3 PosWorldSpace;
+out vec2 TexCoord;
+
+layout (std140) uniform Camera // camera of the current pass (binding point shared by all programs)
+{
+    mat4 view;
+    mat4 projection;
+    vec4 position;
+} camera;
+
+layout (std140) uniform Scene // light and fog
+{
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 fogColor;
+} scene;
+
+uniform mat4 model;
+
+uniform sampler2D heightMap;
+uniform vec2 heightMapSize;   // height map size in texels
+uniform vec2 terrainSize;     // model-space extent of the terrain along the x and z axes
+uniform float horizontalScale; // model-space distance between neighboring texels
+uniform float verticalScale;   // model-space height of a texel value of 1.0
+uniform float gridDim;         // number of quads along each side of the current patch mesh
+uniform vec2 morphRanges[12];  // per LOD level: distances at which morphing into the next coarser level starts and ends
+
+//! Samples the height map at a model-space (x, z) position.
+float sampleHeight(vec2 pos)
+{
+    vec2 uv = (pos / horizontalScale + 0.5) / heightMapSize; // texel centers lie at integer multiples of horizontalScale
+    return textureLod(heightMap, uv, 0.0).r * verticalScale;
+}
+
+void main()
+{
+    float cellSize = aNode.z / gridDim;
+    vec2 pos = aNode.xy + aGrid * cellSize;
+
+    // morph factor: 0 inside the level's range, growing to 1 at its end where the grid has to match the next coarser level
+    vec3 approxWorld = vec3(model * vec4(pos.x, sampleHeight(min(pos, terrainSize)), pos.y, 1.0));
+    vec2 range = morphRanges[int(aNode.w)];
+    float morph = clamp((distance(camera.position.xyz, approxWorld) - range.x) / (range.y - range.x), 0.0, 1.0);
+
+    // odd grid vertices slide onto their even neighbor, so that a fully morphed patch becomes the 2x coarser grid
+    pos -= mod(aGrid, 2.0) * cellSize * morph;
+    pos = min(pos, terrainSize); // patches overlapping the map border collapse onto it
+
+    PosWorldSpace = vec3(model * vec4(pos.x, sampleHeight(pos), pos.y, 1.0));
+    TexCoord = pos / terrainSize;
+    gl_Position = camera.projection * camera.view * vec4(PosWorldSpace, 1.0);
+}
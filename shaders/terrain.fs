@@ -1,12 +1,23 @@
 #version 330 core
 
 in vec3 PosWorldSpace;
-in vec4 PosLightSpace;
 in vec2 TexCoord; 
 
 out vec4 FragColor;
 
-uniform float clipPlane;
+layout (std140) uniform Scene // light and fog
+{
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 fogColor;
+} scene;
+
+layout (std140) uniform Shadows // cascaded shadow maps
+{
+    mat4 cascades[4];  // light view-projection of each cascade, finest first
+    vec4 cascadeCount; // x: number of cascades in use
+} shadows;
+
 uniform float detailLevel;
 uniform sampler2D mainTexture;
 uniform sampler2D detailTexture;
@@ -14,29 +25,33 @@ uniform samplerCube skyboxReflectionTexture;
 uniform vec3 skyboxScaleRatio;
 
 uniform bool lighting;
-uniform vec3 lightPos;
-uniform vec3 lightColor;
 uniform float ambientStrength;
 uniform float diffuseStrength;
-uniform sampler2D shadowMap;
+uniform sampler2DArray shadowMap; // one layer per cascade
 
-//! Checks if the fragment is in shadow, returns 1.0 if true.
-float checkShadow(vec4 PosLightSpace)
+//! Checks if the fragment is in shadow, returns 1.0 if true (looks it up in the finest cascade that contains it; fragments outside all cascades are lit).
+float checkShadow(vec3 PosWorldSpace)
 {
-    vec3 projCoords = PosLightSpace.xyz / PosLightSpace.w; // transform the fragment position into light space
-    projCoords = projCoords * 0.5 + 0.5;                   // convert to [0, 1] range
+    for (int i = 0; i < int(shadows.cascadeCount.x); i++)
+    {
+        vec4 PosLightSpace = shadows.cascades[i] * vec4(PosWorldSpace, 1.0);
+        vec3 projCoords = PosLightSpace.xyz / PosLightSpace.w; // transform the fragment position into light space
+        projCoords = projCoords * 0.5 + 0.5;                   // convert to [0, 1] range
 
-    float currentDepth = projCoords.z;                        // distance from the light to the current fragment
-    float closestDepth = texture(shadowMap, projCoords.xy).r; // distance from the light to the nearest surface at the current fragment's position (sampled from the shadow map)
+        if (any(lessThan(projCoords.xy, vec2(0.0))) || any(greaterThan(projCoords.xy, vec2(1.0))))
+            continue;
 
-    return (currentDepth > closestDepth + 0.005) ? 1.0 : 0.0; // if the fragment is farther than the stored closest depth + bias, it's in shadow
+        float currentDepth = projCoords.z;                                 // distance from the light to the current fragment
+        float closestDepth = texture(shadowMap, vec3(projCoords.xy, i)).r; // distance from the light to the nearest surface at the current fragment's position (sampled from the cascade)
+
+        return (currentDepth > closestDepth + 0.005) ? 1.0 : 0.0; // if the fragment is farther than the stored closest depth + bias, it's in shadow
+    }
+
+    return 0.0;
 }
 
 void main()
-{    
-    if (PosWorldSpace.y < clipPlane)
-        discard;
-
+{
     // base terrain + detail
     vec4 terrain = texture(mainTexture, TexCoord);
     vec4 detail = texture(detailTexture, TexCoord * detailLevel);
@@ -46,12 +61,12 @@ void main()
     if (lighting)
     {
         vec3 N = normalize(cross(dFdx(PosWorldSpace), dFdy(PosWorldSpace))); // compute the fragment's normal vector as the cross product of partial derivatives (obtained using built-in functions) of its world space position
-        vec3 L = normalize(lightPos - PosWorldSpace);
+        vec3 L = normalize(scene.lightPos.xyz - PosWorldSpace);
         float diff = max(dot(N, L), 0.0);
-        float isInShadow = checkShadow(PosLightSpace);
+        float isInShadow = checkShadow(PosWorldSpace);
 
-        vec3 ambient = ambientStrength * lightColor;
-        vec3 diffuse = diffuseStrength * lightColor * diff * (1.0 - isInShadow); // apply diffuse lighting only if the fragment is not in shadow (this allows for rendering shadowed areas)
+        vec3 ambient = ambientStrength * scene.lightColor.rgb;
+        vec3 diffuse = diffuseStrength * scene.lightColor.rgb * diff * (1.0 - isInShadow); // apply diffuse lighting only if the fragment is not in shadow (this allows for rendering shadowed areas)
 
         vec3 result = (ambient + diffuse) * baseColor.rgb;
 
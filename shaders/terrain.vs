@@ -3,18 +3,27 @@ layout (location = 0) in vec3 aPos;
 layout (location = 2) in vec2 aTexCoord;
 
 out vec3 PosWorldSpace;
-out vec4 PosLightSpace;
 out vec2 TexCoord;
 
-uniform mat4 projection;
-uniform mat4 view;
+layout (std140) uniform Camera // camera of the current pass (binding point shared by all programs)
+{
+    mat4 view;
+    mat4 projection;
+    vec4 position;
+} camera;
+
+layout (std140) uniform Scene // light and fog
+{
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 fogColor;
+} scene;
+
 uniform mat4 model;
-uniform mat4 lightSpaceMatrix; 
 
 void main()
 {
     PosWorldSpace = vec3(model * vec4(aPos, 1.0));
-    PosLightSpace = lightSpaceMatrix * vec4(PosWorldSpace, 1.0);
     TexCoord = aTexCoord;
-    gl_Position = projection * view * vec4(PosWorldSpace, 1.0); 
+    gl_Position = camera.projection * camera.view * vec4(PosWorldSpace, 1.0); 
 }
\ No newline at end of file
@@ -1,52 +1,81 @@
 #version 330 core
 
 in vec3 PosWorldSpace;
-in vec4 PosLightSpace;
 in vec3 Normal;
 in vec2 TexCoord;
 in vec4 ReflectCoord;
+in vec2 OceanCoord;
 
 out vec4 FragColor;
 
-uniform vec3 cameraPos;
+layout (std140) uniform Camera // camera of the current pass (binding point shared by all programs)
+{
+    mat4 view;
+    mat4 projection;
+    vec4 position;
+} camera;
+
+layout (std140) uniform Scene // light and fog
+{
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 fogColor;
+} scene;
+
+layout (std140) uniform Shadows // cascaded shadow maps
+{
+    mat4 cascades[4];  // light view-projection of each cascade, finest first
+    vec4 cascadeCount; // x: number of cascades in use
+} shadows;
+
 uniform sampler2D waterTexture;
 uniform sampler2D terrainReflectionTexture;
+uniform vec4 reflectionRegion; // xy: scale from screen coordinates to the part of the reflection texture in use (adaptive resolution), zw: largest coordinate inside it
 uniform samplerCube skyboxReflectionTexture;
 uniform float terrainReflectionStrength;
 uniform float skyboxReflectionStrength;
 uniform vec3 skyboxScaleRatio;
 
+uniform bool oceanWaves;
+uniform sampler2D oceanSlope;
+
 uniform bool lighting;
-uniform vec3 lightPos;
-uniform vec3 lightColor;
 uniform float ambientStrength;
 uniform float diffuseStrength;
 uniform float specularStrength;
-uniform sampler2D shadowMap;
+uniform sampler2DArray shadowMap; // one layer per cascade
 
 uniform bool weather;
-uniform vec4 fogColor;
 uniform float fogStart;
 uniform float fogEnd;
 
 //! Applies distance-based fog.
 vec3 applyFog(vec3 sceneColor) {
-    float dist = length(cameraPos - PosWorldSpace);
+    float dist = length(camera.position.xyz - PosWorldSpace);
     float linearF = clamp((dist - fogStart) / (fogEnd - fogStart), 0.0, 1.0); // calculate linear fog factor
 
-    return mix(sceneColor, fogColor.rgb, linearF);
+    return mix(sceneColor, scene.fogColor.rgb, linearF);
 }
 
-//! Checks if the fragment is in shadow, returns 1.0 if true.
-float checkShadow(vec4 PosLightSpace)
+//! Checks if the fragment is in shadow, returns 1.0 if true (looks it up in the finest cascade that contains it; fragments outside all cascades are lit).
+float checkShadow(vec3 PosWorldSpace)
 {
-    vec3 projCoords = PosLightSpace.xyz / PosLightSpace.w; // transform the fragment position into light space to range [-1, 1] (Normalized Device Coordinates)
-    projCoords = projCoords * 0.5 + 0.5;                   // convert to [0, 1] range
+    for (int i = 0; i < int(shadows.cascadeCount.x); i++)
+    {
+        vec4 PosLightSpace = shadows.cascades[i] * vec4(PosWorldSpace, 1.0);
+        vec3 projCoords = PosLightSpace.xyz / PosLightSpace.w; // transform the fragment position into light space to range [-1, 1] (Normalized Device Coordinates)
+        projCoords = projCoords * 0.5 + 0.5;                   // convert to [0, 1] range
+
+        if (any(lessThan(projCoords.xy, vec2(0.0))) || any(greaterThan(projCoords.xy, vec2(1.0))))
+            continue;
+
+        float currentDepth = projCoords.z;                                 // distance from the light to the current fragment
+        float closestDepth = texture(shadowMap, vec3(projCoords.xy, i)).r; // distance from the light to the nearest surface at the current fragment's position (sampled from the cascade)
 
-    float currentDepth = projCoords.z;                        // distance from the light to the current fragment
-    float closestDepth = texture(shadowMap, projCoords.xy).r; // distance from the light to the nearest surface at the current fragment's position (sampled from the shadow map)
+        return (currentDepth > closestDepth + 0.005) ? 1.0 : 0.0; // if the fragment is farther than the stored closest depth + bias, it's in shadow
+    }
 
-    return (currentDepth > closestDepth + 0.005) ? 1.0 : 0.0; // if the fragment is farther than the stored closest depth + bias, it's in shadow
+    return 0.0;
 }
 
 void main()
@@ -58,11 +87,16 @@ void main()
     // planar terrain reflection
     vec3 projCoords = ReflectCoord.xyz / ReflectCoord.w;
     projCoords = projCoords * 0.5 + 0.5;
-    vec4 terrainRefl = texture(terrainReflectionTexture, projCoords.xy);
+    vec4 terrainRefl = texture(terrainReflectionTexture, min(projCoords.xy * reflectionRegion.xy, reflectionRegion.zw));
 
     // skybox reflection
     vec3 N = normalize(Normal);
-    vec3 I = normalize(cameraPos - PosWorldSpace); // view direction vector
+    if (oceanWaves)
+    {
+        vec2 slope = texture(oceanSlope, OceanCoord).xy;
+        N = normalize(vec3(-slope.x, 1.0, -slope.y));
+    }
+    vec3 I = normalize(camera.position.xyz - PosWorldSpace); // view direction vector
     vec3 R = reflect(-I, N);                       // reflection vector
     vec4 skyRefl = texture(skyboxReflectionTexture, normalize(R / skyboxScaleRatio));
 
@@ -71,17 +105,17 @@ void main()
     // lighting (Phong lighting model: ambient + diffuse + specular)
     if (lighting)
     {
-        vec3 L = normalize(lightPos - PosWorldSpace); // light direction vector
+        vec3 L = normalize(scene.lightPos.xyz - PosWorldSpace); // light direction vector
         float diff = max(dot(N, L), 0.0);             // measure how aligned the surface is with the light (cos = 1 means the light hits water surface directly)
-        float isInShadow = checkShadow(PosLightSpace);
+        float isInShadow = checkShadow(PosWorldSpace);
 
         vec3 R = reflect(-L, N);
         float spec = pow(max(dot(I, R), 0.0), 64.0); // measure how aligned the view direction is with the reflected light (cos = 1 means the light reflection hits the camera)
 
-        vec3 ambient = ambientStrength  * lightColor;
-        vec3 diffuse = diffuseStrength  * lightColor * diff * (1.0 - isInShadow); // apply diffuse lighting only if the fragment is not in shadow (this allows for rendering shadowed areas)
+        vec3 ambient = ambientStrength  * scene.lightColor.rgb;
+        vec3 diffuse = diffuseStrength  * scene.lightColor.rgb * diff * (1.0 - isInShadow); // apply diffuse lighting only if the fragment is not in shadow (this allows for rendering shadowed areas)
 
-        vec3 specular = specularStrength * lightColor * spec;
+        vec3 specular = specularStrength * scene.lightColor.rgb * spec;
 
         result = (ambient + diffuse + specular) * result;
     }
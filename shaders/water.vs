@@ -4,24 +4,81 @@ layout (location=  1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
 
 out vec3 PosWorldSpace;
-out vec4 PosLightSpace;
 out vec3 Normal;
 out vec2 TexCoord;
 out vec4 ReflectCoord;
+out vec2 OceanCoord;
+
+layout (std140) uniform Camera // camera of the current pass (binding point shared by all programs)
+{
+    mat4 view;
+    mat4 projection;
+    vec4 position;
+} camera;
+
+layout (std140) uniform ReflectedCamera // same layout as Camera, mirrored below the water plane
+{
+    mat4 view;
+    mat4 projection;
+    vec4 position;
+} reflectedCamera;
+
+layout (std140) uniform Scene // light and fog
+{
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 fogColor;
+} scene;
 
-uniform mat4 projection;
-uniform mat4 view;
 uniform mat4 model;
-uniform mat4 reflected_view;
-uniform mat4 lightSpaceMatrix;
 uniform float offset;
 
+uniform bool gpuWaves; // if true, aPos is a flat grid point and the Gerstner waves are evaluated here (aNormal is not provided)
+uniform float time;
+uniform float waveAmp;
+uniform float waveFreq;
+uniform float waveSpeed;
+uniform float horizontalScale;
+
+uniform bool oceanWaves; // if true, aPos is a flat grid point displaced by the FFT ocean patch (tiled over the surface)
+uniform sampler2D oceanDisplacement;
+uniform float oceanPatchSize;
+
 void main()
 {
-    PosWorldSpace = vec3(model * vec4(aPos, 1.0));
-    PosLightSpace = lightSpaceMatrix * vec4(PosWorldSpace, 1.0);
-    Normal = mat3(transpose(inverse(model))) * aNormal;         // apply normal matrix to ..
+    vec3 pos = aPos;
+    vec3 normal = aNormal;
+
+    if (gpuWaves && !oceanWaves)
+    {
+        // 2-directional Gerstner wave, same formula as the CPU path in Water (x and z are in model space [-1, 1])
+        float xPhase = waveFreq * (aPos.x * horizontalScale) - waveSpeed * time;
+        float zPhase = waveFreq * (aPos.z * horizontalScale) - waveSpeed * time;
+
+        pos.x += (waveAmp / horizontalScale) * cos(xPhase);
+        pos.z += (waveAmp / horizontalScale) * cos(zPhase);
+        pos.y += waveAmp * (sin(xPhase) + sin(zPhase));
+
+        // analytic partial derivatives of the displaced position instead of central differences
+        float k = waveAmp * waveFreq;
+        vec3 dPdx = vec3(1.0 - k * sin(xPhase), k * horizontalScale * cos(xPhase), 0.0);
+        vec3 dPdz = vec3(0.0, k * horizontalScale * cos(zPhase), 1.0 - k * sin(zPhase));
+        normal = normalize(cross(dPdz, dPdx));
+    }
+
+    PosWorldSpace = vec3(model * vec4(pos, 1.0));
+    OceanCoord = vec2(0.0);
+
+    if (oceanWaves)
+    {
+        // the displacement is in world units; the normal comes from the slope texture per fragment
+        OceanCoord = PosWorldSpace.xz / oceanPatchSize;
+        PosWorldSpace += textureLod(oceanDisplacement, OceanCoord, 0.0).xyz;
+        normal = vec3(0.0, 1.0, 0.0);
+    }
+
+    Normal = mat3(transpose(inverse(model))) * normal;          // apply normal matrix to ..
     TexCoord = aTexCoord + vec2(offset, 0.0);                   // animate water by offsetting texture coordinates horizontally
-    ReflectCoord = projection * reflected_view * vec4(PosWorldSpace, 1.0); // reflect world position across a horizontal plane (planar reflection)
-    gl_Position = projection * view * vec4(PosWorldSpace, 1.0);
+    ReflectCoord = reflectedCamera.projection * reflectedCamera.view * vec4(PosWorldSpace, 1.0); // reflect world position across a horizontal plane (planar reflection)
+    gl_Position = camera.projection * camera.view * vec4(PosWorldSpace, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,51 @@
+#ifndef SHADOW_CACHE_H
+#define SHADOW_CACHE_H
+
+#include <glm/glm.hpp>
+
+bool cacheShadows = true; // reuse the shadow map while nothing it depends on changes (key C), otherwise render it every frame
+
+// state of the terrain that its shadow depth depends on (filled in by Terrain::shadowState)
+struct TerrainShadowState
+{
+    bool lod;                  // rendered with the LOD renderer
+    glm::vec3 lodObserver;     // LOD only: the selection and morphing follow the camera
+    unsigned long tileUploads; // streaming only: height map tiles uploaded so far
+};
+
+// everything the contents of the shadow map depend on
+struct ShadowCacheKey
+{
+    glm::mat4 lightSpace;
+    unsigned int width, height;
+    TerrainShadowState terrain;
+
+    bool operator==(const ShadowCacheKey &other) const
+    {
+        return lightSpace == other.lightSpace && width == other.width && height == other.height && terrain.lod == other.terrain.lod &&
+               (!terrain.lod || (terrain.lodObserver == other.terrain.lodObserver && terrain.tileUploads == other.terrain.tileUploads));
+    }
+};
+
+// tracks whether the static shadow map is still valid: the light and the full-resolution terrain never change, so the depth map is rendered once and reused
+// (the LOD terrain changes its shadow geometry as the camera moves and as tiles stream in, which invalidates the cache; there are no dynamic shadow casters, which would be drawn over a copy of the cached map)
+class ShadowCache
+{
+public:
+    //! Returns true if the shadow map has to be rendered for the given state, which then becomes the cached one.
+    bool needsUpdate(const ShadowCacheKey &key)
+    {
+        if (valid && key == cached)
+            return false;
+
+        cached = key;
+        valid = true;
+        return true;
+    }
+
+private:
+    ShadowCacheKey cached;
+    bool valid = false;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef SHADOW_CASCADES_H
+#define SHADOW_CASCADES_H
+
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+// cascaded shadow maps: the view frustum of the camera is split by distance into slices, each covered by its own orthographic light projection and its own layer of a depth texture array,
+// so that near terrain gets small texels and far terrain large ones (instead of one map spread evenly over the whole scene)
+const int maxShadowCascades = 4;
+int shadowCascades = 4;                           // number of cascades in use, 1 – maxShadowCascades (--shadow-cascades <n>)
+const unsigned int shadowMapSize = 1024;          // resolution of each cascade
+const float shadowDistance = 50.0f;               // view distance covered by the cascades (farther fragments are not shadowed)
+const float cascadeSplitLambda = 0.75f;           // distribution of the split distances: 0 – uniform, 1 – logarithmic
+const float lightNear = 1.0f, lightFar = 100.0f;  // depth range of the light projections along the light direction (the whole scene as seen from lightPos)
+
+//! Computes the orthographic light projection of each cascade (finest first, to be combined with lightView) for the given camera and perspective parameters. Each slice of the view frustum is enclosed in a sphere,
+//! whose size does not depend on the camera orientation, and the projection is moved in whole texels only, so that shadow edges do not shimmer as the camera moves and turns.
+void fitShadowCascades(const Camera &camera, float fovY, float aspect, float near, const glm::mat4 &lightView, glm::mat4 projections[maxShadowCascades])
+{
+    float tanHalfFov = std::tan(fovY / 2.0f);
+    float sliceNear = near;
+
+    for (int i = 0; i < shadowCascades; i++)
+    {
+        // split distance: blend of the logarithmic split (even texel density) and the uniform split (not too small near cascades)
+        float t = (i + 1) / (float)shadowCascades;
+        float logSplit = near * std::pow(shadowDistance / near, t);
+        float uniformSplit = near + (shadowDistance - near) * t;
+        float sliceFar = cascadeSplitLambda * logSplit + (1.0f - cascadeSplitLambda) * uniformSplit;
+
+        // bounding sphere of the 8 corners of the slice
+        glm::vec3 corners[8];
+        glm::vec3 center(0.0f);
+        for (int c = 0; c < 8; c++)
+        {
+            float depth = (c & 4) ? sliceFar : sliceNear;
+            float height = depth * tanHalfFov, width = height * aspect;
+            corners[c] = camera.Position + camera.Front * depth + camera.Right * ((c & 1) ? width : -width) + camera.Up * ((c & 2) ? height : -height);
+            center += corners[c] / 8.0f;
+        }
+
+        float radius = 0.0f;
+        for (const glm::vec3 &corner : corners)
+            radius = std::max(radius, glm::length(corner - center));
+        radius = std::ceil(radius * 16.0f) / 16.0f; // remove rounding noise between frames
+
+        // snap the center (in light space) to the texel grid of the cascade
+        float texel = 2.0f * radius / shadowMapSize;
+        glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+        lightCenter.x = std::floor(lightCenter.x / texel) * texel;
+        lightCenter.y = std::floor(lightCenter.y / texel) * texel;
+
+        projections[i] = glm::ortho(lightCenter.x - radius, lightCenter.x + radius, lightCenter.y - radius, lightCenter.y + radius, lightNear, lightFar);
+        sliceNear = sliceFar;
+    }
+}
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <immintrin.h>
+
+// thin wrappers over SSE2 / AVX2 intrinsics, so that kernels are written once for the widest instruction set enabled at compile time (build with -march=native for AVX2 + FMA)
+namespace simd
+{
+#if defined(__AVX2__) && defined(__FMA__)
+    typedef __m256 floatv;
+    typedef __m256i intv;
+    const int width = 8;
+
+    inline floatv set1(float a) { return _mm256_set1_ps(a); }
+    inline floatv load(const float *p) { return _mm256_loadu_ps(p); }
+    inline void store(float *p, floatv a) { _mm256_storeu_ps(p, a); }
+    inline floatv ramp(float first) { return _mm256_add_ps(_mm256_set1_ps(first), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)); } // first, first + 1, ...
+    inline floatv add(floatv a, floatv b) { return _mm256_add_ps(a, b); }
+    inline floatv sub(floatv a, floatv b) { return _mm256_sub_ps(a, b); }
+    inline floatv mul(floatv a, floatv b) { return _mm256_mul_ps(a, b); }
+    inline floatv fmadd(floatv a, floatv b, floatv c) { return _mm256_fmadd_ps(a, b, c); }   // a * b + c
+    inline floatv fnmadd(floatv a, floatv b, floatv c) { return _mm256_fnmadd_ps(a, b, c); } // c - a * b
+    inline floatv rsqrtEstimate(floatv a) { return _mm256_rsqrt_ps(a); }
+    inline floatv bitAnd(floatv a, floatv b) { return _mm256_and_ps(a, b); }
+    inline floatv bitAndNot(floatv a, floatv b) { return _mm256_andnot_ps(a, b); } // ~a & b
+    inline floatv bitOr(floatv a, floatv b) { return _mm256_or_ps(a, b); }
+    inline floatv bitXor(floatv a, floatv b) { return _mm256_xor_ps(a, b); }
+    inline floatv lessEqual(floatv a, floatv b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); } // all bits set in the lanes where a <= b
+    inline int moveMask(floatv mask) { return _mm256_movemask_ps(mask); }                    // bit i = sign of lane i
+
+    inline intv set1i(int a) { return _mm256_set1_epi32(a); }
+    inline intv roundToInt(floatv a) { return _mm256_cvtps_epi32(a); }
+    inline floatv toFloat(intv a) { return _mm256_cvtepi32_ps(a); }
+    inline intv addi(intv a, intv b) { return _mm256_add_epi32(a, b); }
+    inline intv andi(intv a, intv b) { return _mm256_and_si256(a, b); }
+    inline intv equali(intv a, intv b) { return _mm256_cmpeq_epi32(a, b); }
+    template <int bits>
+    inline intv shiftLeft(intv a) { return _mm256_slli_epi32(a, bits); }
+    inline floatv asFloat(intv a) { return _mm256_castsi256_ps(a); }
+
+    //! Writes width records of 8 floats: record k is (c[0][k], c[1][k], ..., c[7][k]), e.g. interleaved vertices from 8 attribute component vectors (8x8 transpose).
+    inline void storeInterleaved8(float *dst, const floatv c[8])
+    {
+        __m256 t0 = _mm256_unpacklo_ps(c[0], c[1]), t1 = _mm256_unpackhi_ps(c[0], c[1]);
+        __m256 t2 = _mm256_unpacklo_ps(c[2], c[3]), t3 = _mm256_unpackhi_ps(c[2], c[3]);
+        __m256 t4 = _mm256_unpacklo_ps(c[4], c[5]), t5 = _mm256_unpackhi_ps(c[4], c[5]);
+        __m256 t6 = _mm256_unpacklo_ps(c[6], c[7]), t7 = _mm256_unpackhi_ps(c[6], c[7]);
+
+        __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)), s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)), s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0)), s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0)), s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+        _mm256_storeu_ps(dst + 0 * 8, _mm256_permute2f128_ps(s0, s4, 0x20));
+        _mm256_storeu_ps(dst + 1 * 8, _mm256_permute2f128_ps(s1, s5, 0x20));
+        _mm256_storeu_ps(dst + 2 * 8, _mm256_permute2f128_ps(s2, s6, 0x20));
+        _mm256_storeu_ps(dst + 3 * 8, _mm256_permute2f128_ps(s3, s7, 0x20));
+        _mm256_storeu_ps(dst + 4 * 8, _mm256_permute2f128_ps(s0, s4, 0x31));
+        _mm256_storeu_ps(dst + 5 * 8, _mm256_permute2f128_ps(s1, s5, 0x31));
+        _mm256_storeu_ps(dst + 6 * 8, _mm256_permute2f128_ps(s2, s6, 0x31));
+        _mm256_storeu_ps(dst + 7 * 8, _mm256_permute2f128_ps(s3, s7, 0x31));
+    }
+#else
+    typedef __m128 floatv;
+    typedef __m128i intv;
+    const int width = 4;
+
+    inline floatv set1(float a) { return _mm_set1_ps(a); }
+    inline floatv load(const float *p) { return _mm_loadu_ps(p); }
+    inline void store(float *p, floatv a) { _mm_storeu_ps(p, a); }
+    inline floatv ramp(float first) { return _mm_add_ps(_mm_set1_ps(first), _mm_setr_ps(0, 1, 2, 3)); }
+    inline floatv add(floatv a, floatv b) { return _mm_add_ps(a, b); }
+    inline floatv sub(floatv a, floatv b) { return _mm_sub_ps(a, b); }
+    inline floatv mul(floatv a, floatv b) { return _mm_mul_ps(a, b); }
+    inline floatv fmadd(floatv a, floatv b, floatv c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    inline floatv fnmadd(floatv a, floatv b, floatv c) { return _mm_sub_ps(c, _mm_mul_ps(a, b)); }
+    inline floatv rsqrtEstimate(floatv a) { return _mm_rsqrt_ps(a); }
+    inline floatv bitAnd(floatv a, floatv b) { return _mm_and_ps(a, b); }
+    inline floatv bitAndNot(floatv a, floatv b) { return _mm_andnot_ps(a, b); }
+    inline floatv bitOr(floatv a, floatv b) { return _mm_or_ps(a, b); }
+    inline floatv bitXor(floatv a, floatv b) { return _mm_xor_ps(a, b); }
+    inline floatv lessEqual(floatv a, floatv b) { return _mm_cmple_ps(a, b); }
+    inline int moveMask(floatv mask) { return _mm_movemask_ps(mask); }
+
+    inline intv set1i(int a) { return _mm_set1_epi32(a); }
+    inline intv roundToInt(floatv a) { return _mm_cvtps_epi32(a); }
+    inline floatv toFloat(intv a) { return _mm_cvtepi32_ps(a); }
+    inline intv addi(intv a, intv b) { return _mm_add_epi32(a, b); }
+    inline intv andi(intv a, intv b) { return _mm_and_si128(a, b); }
+    inline intv equali(intv a, intv b) { return _mm_cmpeq_epi32(a, b); }
+    template <int bits>
+    inline intv shiftLeft(intv a) { return _mm_slli_epi32(a, bits); }
+    inline floatv asFloat(intv a) { return _mm_castsi128_ps(a); }
+
+    //! Writes width records of 8 floats (see the AVX2 version), as two 4x4 transposes.
+    inline void storeInterleaved8(float *dst, const floatv c[8])
+    {
+        __m128 a0 = c[0], a1 = c[1], a2 = c[2], a3 = c[3];
+        __m128 b0 = c[4], b1 = c[5], b2 = c[6], b3 = c[7];
+        _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+        _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+
+        _mm_storeu_ps(dst + 0, a0), _mm_storeu_ps(dst + 4, b0);
+        _mm_storeu_ps(dst + 8, a1), _mm_storeu_ps(dst + 12, b1);
+        _mm_storeu_ps(dst + 16, a2), _mm_storeu_ps(dst + 20, b2);
+        _mm_storeu_ps(dst + 24, a3), _mm_storeu_ps(dst + 28, b3);
+    }
+#endif
+
+    inline floatv select(floatv mask, floatv a, floatv b) { return bitOr(bitAnd(mask, a), bitAndNot(mask, b)); } // mask ? a : b
+
+    //! 1 / sqrt(a) from the hardware estimate refined with one Newton-Raphson step (~23 bits).
+    inline floatv rsqrt(floatv a)
+    {
+        floatv y = rsqrtEstimate(a);
+        return mul(mul(set1(0.5f), y), fnmadd(mul(a, y), y, set1(3.0f)));
+    }
+
+    //! Sine and cosine together: reduction by the nearest multiple of pi/2 (in 3 parts, for precision), then minimax polynomials on [-pi/4, pi/4] (Cephes coefficients). Max error ~1e-7 for |x| up to a few thousand.
+    inline void sincos(floatv x, floatv &s, floatv &c)
+    {
+        intv quadrant = roundToInt(mul(x, set1(0.636619772f))); // x * 2 / pi
+        floatv q = toFloat(quadrant);
+
+        floatv r = fnmadd(q, set1(1.5703125f), x);
+        r = fnmadd(q, set1(4.837512969970703125e-4f), r);
+        r = fnmadd(q, set1(7.54978995489188216e-8f), r);
+        floatv r2 = mul(r, r);
+
+        floatv sinPoly = fmadd(fmadd(fmadd(set1(-1.9515295891e-4f), r2, set1(8.3321608736e-3f)), r2, set1(-1.6666654611e-1f)), mul(r2, r), r);
+        floatv cosPoly = fmadd(fmadd(fmadd(set1(2.443315711809948e-5f), r2, set1(-1.388731625493765e-3f)), r2, set1(4.166664568298827e-2f)), mul(r2, r2), fnmadd(set1(0.5f), r2, set1(1.0f)));
+
+        // quadrants 1 and 3 swap sine and cosine; sine is negative in quadrants 2, 3 and cosine in quadrants 1, 2
+        floatv swap = asFloat(equali(andi(quadrant, set1i(1)), set1i(1)));
+        floatv sinSign = asFloat(shiftLeft<30>(andi(quadrant, set1i(2))));
+        floatv cosSign = asFloat(shiftLeft<30>(andi(addi(quadrant, set1i(1)), set1i(2))));
+
+        s = bitXor(select(swap, cosPoly, sinPoly), sinSign);
+        c = bitXor(select(swap, sinPoly, cosPoly), cosSign);
+    }
+}
+
+#endif
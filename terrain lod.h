@@ -0,0 +1,383 @@
+#ifndef TERRAIN_LOD_H
+#define TERRAIN_LOD_H
+
+#include <cfloat>
+
+// continuous level of detail (CDLOD) settings
+const int lodPatchSize = 32;           // number of quads along each side of the patch mesh (LOD 0 patch covers lodPatchSize height map texels)
+const int lodGridLevels = 6;           // patch meshes with lodPatchSize >> b quads per side, b in [0, lodGridLevels) (used to cover parts of a node at the node's resolution)
+const int lodMaxLevels = 12;           // max depth of the quadtree (must match the size of the morphRanges array in terrain lod.vs)
+const float lodRangeFactor = 3.0f;     // visibility range of LOD 0, in multiples of the LOD 0 node size (doubles with every level)
+const float lodMorphStartRatio = 0.7f; // morphing toward the next coarser level starts at this fraction of the level's range
+
+// a selected quadtree node, uploaded as per-instance data: model-space origin (x, z), model-space size, LOD level
+struct LODNode
+{
+    float x, z, size, level;
+};
+
+// quadtree-based terrain renderer: height map lives in a texture, a single small patch mesh is instanced over the selected quadtree nodes and displaced in the vertex shader, vertices morph smoothly into the next coarser grid with distance from the observer
+// (vertex count depends on the number of selected nodes, i.e. on the view, and not on the height map resolution)
+// the height texture either holds the whole map, or is the streamed window of a TileStreamer, in which case only the parts of the map present in the window are drawn
+class TerrainLOD
+{
+public:
+    unsigned int VAO, VBO, EBO, instanceVBO;
+    unsigned int heightTexture;
+    int mapWidth, mapHeight;                     // height map size in texels
+    int levels;                                  // number of quadtree levels (root is at level levels - 1)
+    float ranges[lodMaxLevels];                  // per level: max distance from the observer at which the level is used
+    std::vector<glm::vec2> minMax[lodMaxLevels]; // per level: min and max height of each node (row-major, nodesPerSide(level)^2 entries)
+    std::vector<LODNode> nodes[lodGridLevels];   // selected areas, grouped by patch mesh: nodes[b] are drawn with lodPatchSize >> b quads per side (b = 0: whole nodes, b > 0: parts of a node at the node's level)
+    unsigned int firstIndex[lodGridLevels], indexCount[lodGridLevels];
+    glm::vec3 observer;                          // model-space position used for LOD distances during the current selection
+    const Frustum *frustum;                      // frustum used for culling during the current selection
+    TileStreamer *streamer;                      // source of the height texture in streaming mode (nullptr if the whole map is in memory)
+
+    //! Builds the height texture, min/max quadtree and patch meshes from an 8-bit height map of width x height texels (row-major, rows along the z-axis).
+    TerrainLOD(const unsigned char *heights, int width, int height)
+        : mapWidth(width),
+          mapHeight(height),
+          frustum(nullptr),
+          streamer(nullptr)
+    {
+        // height texture (sampled in the vertex shader)
+        glGenTextures(1, &heightTexture);
+        glState.bindTexture(GL_TEXTURE_2D, heightTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // rows of a single-channel image are not necessarily 4-byte aligned
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, heights);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        buildQuadtree([&](int nx, int nz)
+                      {
+                          glm::vec2 mm(FLT_MAX, -FLT_MAX);
+                          for (int i = nz * lodPatchSize; i <= std::min((nz + 1) * lodPatchSize, height - 1); i++)
+                          {
+                              for (int j = nx * lodPatchSize; j <= std::min((nx + 1) * lodPatchSize, width - 1); j++)
+                              {
+                                  mm.x = std::min(mm.x, (float)heights[i * width + j]);
+                                  mm.y = std::max(mm.y, (float)heights[i * width + j]);
+                              }
+                          }
+                          return mm * terrainVerticalScale;
+                      });
+        buildMeshes();
+    }
+
+    //! Streaming mode: heights come from the window texture of a tile streamer, node bounds from its per-tile min/max table (conservative, no texel data needed).
+    TerrainLOD(TileStreamer &tiles)
+        : heightTexture(tiles.texture),
+          mapWidth(tiles.header.width),
+          mapHeight(tiles.header.height),
+          frustum(nullptr),
+          streamer(&tiles)
+    {
+        int tileSize = tiles.header.tileSize;
+        buildQuadtree([&](int nx, int nz)
+                      {
+                          glm::vec2 mm(FLT_MAX, -FLT_MAX);
+                          for (int tz = nz * lodPatchSize / tileSize; tz <= std::min((nz + 1) * lodPatchSize, mapHeight - 1) / tileSize; tz++)
+                          {
+                              for (int tx = nx * lodPatchSize / tileSize; tx <= std::min((nx + 1) * lodPatchSize, mapWidth - 1) / tileSize; tx++)
+                              {
+                                  glm::vec2 tile = tiles.tileMinMax(tx, tz);
+                                  mm.x = std::min(mm.x, tile.x);
+                                  mm.y = std::max(mm.y, tile.y);
+                              }
+                          }
+                          return mm * terrainVerticalScale;
+                      });
+        buildMeshes();
+    }
+
+    //! Number of nodes along each side of the map at the given quadtree level.
+    int nodesPerSide(int level)
+    {
+        int texels = lodPatchSize << level;
+        return (std::max(mapWidth, mapHeight) - 1 + texels - 1) / texels;
+    }
+
+    //! Model-space size of a node at the given quadtree level.
+    float nodeSize(int level)
+    {
+        return (lodPatchSize << level) * terrainHorizontalScale;
+    }
+
+    //! Sets the uniforms of a program using terrain lod.vs that never change.
+    void setupShader(Shader &shader)
+    {
+        shader.use();
+        shader.setInt("heightMap", 4);
+        shader.setVec2("heightMapSize", streamer ? glm::vec2(streamer->windowTexels) : glm::vec2(mapWidth, mapHeight)); // the window texture wraps around (toroidal addressing)
+        shader.setVec2("terrainSize", glm::vec2((mapWidth - 1) * terrainHorizontalScale, (mapHeight - 1) * terrainHorizontalScale));
+        shader.setFloat("horizontalScale", terrainHorizontalScale);
+        shader.setFloat("verticalScale", 255.0f * terrainVerticalScale);
+
+        // morph zone of each level: last (1 - lodMorphStartRatio) part of its range
+        for (int level = 0; level < levels; level++)
+        {
+            float prev = level > 0 ? ranges[level - 1] : 0.0f;
+            float end = (level == levels - 1) ? FLT_MAX : ranges[level];
+            float start = (level == levels - 1) ? FLT_MAX * 0.5f : prev + (end - prev) * lodMorphStartRatio; // root level never morphs
+            shader.setVec2(("morphRanges[" + std::to_string(level) + "]").c_str(), glm::vec2(start, end));
+        }
+    }
+
+    //! Selects the quadtree nodes visible in the given frustum, with detail decreasing with distance from the observer, and uploads them as instance data.
+    void select(const Frustum &viewFrustum, glm::vec3 observerPos)
+    {
+        frustum = &viewFrustum;
+        observer = observerPos - glm::vec3(0.0f, terrainOffset, 0.0f); // selection runs in model space
+        for (int b = 0; b < lodGridLevels; b++)
+            nodes[b].clear();
+
+        selectNode(levels - 1, 0, 0);
+
+        size_t total = 0;
+        for (int b = 0; b < lodGridLevels; b++)
+            total += nodes[b].size();
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, total * sizeof(LODNode), NULL, GL_STREAM_DRAW); // orphan the previous contents
+        size_t offset = 0;
+        for (int b = 0; b < lodGridLevels; b++)
+        {
+            glBufferSubData(GL_ARRAY_BUFFER, offset * sizeof(LODNode), nodes[b].size() * sizeof(LODNode), nodes[b].data());
+            offset += nodes[b].size();
+        }
+    }
+
+    //! Draws the nodes from the last select() call with the (already bound) program using terrain lod.vs that gridDim belongs to.
+    void drawGeometry(UniformHandle<float> gridDim)
+    {
+        glState.bindTexture(4, GL_TEXTURE_2D, heightTexture);
+
+        glState.bindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+
+        // one instanced draw per patch mesh; the instance data of each group follows the previous one
+        size_t offset = 0;
+        for (int b = 0; b < lodGridLevels; b++)
+        {
+            if (nodes[b].empty())
+                continue;
+
+            gridDim.set(lodPatchSize >> b);
+            glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(LODNode), (void *)(offset * sizeof(LODNode)));
+            glDrawElementsInstanced(GL_TRIANGLE_STRIP, indexCount[b], GL_UNSIGNED_INT, (void *)(firstIndex[b] * sizeof(unsigned int)), nodes[b].size());
+            offset += nodes[b].size();
+        }
+    }
+
+    //! Number of vertices submitted by the last drawGeometry() call.
+    size_t vertexCount()
+    {
+        size_t count = 0;
+        for (int b = 0; b < lodGridLevels; b++)
+            count += nodes[b].size() * ((lodPatchSize >> b) + 1) * ((lodPatchSize >> b) + 1);
+        return count;
+    }
+
+    //! World-space bounding box of the whole terrain (the root node).
+    void bounds(glm::vec3 &boxMin, glm::vec3 &boxMax)
+    {
+        nodeBox(levels - 1, 0, 0, boxMin, boxMax);
+    }
+
+private:
+    //! World-space bounding box of a node.
+    void nodeBox(int level, int nx, int nz, glm::vec3 &boxMin, glm::vec3 &boxMax)
+    {
+        float size = nodeSize(level);
+        glm::vec2 mm = minMax[level][nz * nodesPerSide(level) + nx];
+        boxMin = glm::vec3(nx * size, mm.x + terrainOffset, nz * size);
+        boxMax = glm::vec3((nx + 1) * size, mm.y + terrainOffset, (nz + 1) * size);
+    }
+
+    //! Returns true if the node's bounding box is within the given distance of the observer (model-space test).
+    bool inRange(int level, int nx, int nz, float range)
+    {
+        float size = nodeSize(level);
+        glm::vec2 mm = minMax[level][nz * nodesPerSide(level) + nx];
+        glm::vec3 closest = glm::clamp(observer, glm::vec3(nx * size, mm.x, nz * size), glm::vec3((nx + 1) * size, mm.y, (nz + 1) * size));
+        return glm::distance(closest, observer) <= range;
+    }
+
+    //! Builds the min/max quadtree bottom-up from a function returning the model-space (min, max) height of a leaf node.
+    template <typename LeafMinMax>
+    void buildQuadtree(LeafMinMax leafMinMax)
+    {
+        // quadtree depth: enough levels for a single root node to cover the whole map
+        levels = 1;
+        while (levels < lodMaxLevels && nodesPerSide(levels - 1) > 1)
+            levels++;
+
+        for (int level = 0; level < levels; level++)
+        {
+            int n = nodesPerSide(level);
+            minMax[level].assign(n * n, glm::vec2(FLT_MAX, -FLT_MAX));
+
+            for (int nz = 0; nz < n; nz++)
+            {
+                for (int nx = 0; nx < n; nx++)
+                {
+                    glm::vec2 &mm = minMax[level][nz * n + nx];
+
+                    if (level == 0)
+                    {
+                        if (!outsideMap(0, nx, nz))
+                            mm = leafMinMax(nx, nz);
+                        continue;
+                    }
+
+                    int cn = nodesPerSide(level - 1);
+                    for (int c = 0; c < 4; c++)
+                    {
+                        int cx = nx * 2 + (c & 1), cz = nz * 2 + (c >> 1);
+                        if (cx < cn && cz < cn)
+                        {
+                            mm.x = std::min(mm.x, minMax[level - 1][cz * cn + cx].x);
+                            mm.y = std::max(mm.y, minMax[level - 1][cz * cn + cx].y);
+                        }
+                    }
+                }
+            }
+        }
+
+        // LOD ranges double with every level (the root level covers everything)
+        for (int level = 0; level < levels; level++)
+            ranges[level] = lodRangeFactor * nodeSize(0) * (float)(1 << level);
+        ranges[levels - 1] = FLT_MAX;
+    }
+
+    //! Builds the patch meshes (lodPatchSize >> b quads per side, b in [0, lodGridLevels), all spanning the same [0, 1] extent) and the vertex array; vertices hold integer grid coordinates so that odd/even tests in the shader are exact.
+    void buildMeshes()
+    {
+        std::vector<float> vertices;
+        std::vector<unsigned int> indices;
+
+        for (int b = 0; b < lodGridLevels; b++)
+        {
+            int dim = lodPatchSize >> b;
+            unsigned int base = vertices.size() / 2;
+            for (int i = 0; i <= dim; i++)
+            {
+                for (int j = 0; j <= dim; j++)
+                {
+                    vertices.push_back(j);
+                    vertices.push_back(i);
+                }
+            }
+
+            // triangle strips separated by a restart index
+            firstIndex[b] = indices.size();
+            for (int i = 0; i < dim; i++)
+            {
+                for (int j = 0; j <= dim; j++)
+                {
+                    indices.push_back(base + (i + 1) * (dim + 1) + j);
+                    indices.push_back(base + i * (dim + 1) + j);
+                }
+                indices.push_back(restartIndex);
+            }
+            indexCount[b] = indices.size() - firstIndex[b];
+        }
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glGenBuffers(1, &instanceVBO);
+
+        glState.bindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(LODNode), (void *)0);
+        glVertexAttribDivisor(3, 1); // per-instance node data
+        glEnableVertexAttribArray(3);
+        glState.bindVertexArray(0);
+    }
+
+    //! Returns true if the node does not contain any height map texel.
+    bool outsideMap(int level, int nx, int nz)
+    {
+        int texels = lodPatchSize << level;
+        return nx * texels > mapWidth - 1 || nz * texels > mapHeight - 1;
+    }
+
+    //! Returns true if the node's heights can be sampled (always, unless streaming).
+    bool isDrawable(int level, int nx, int nz)
+    {
+        int texels = lodPatchSize << level;
+        return !streamer || streamer->isAreaUploaded(nx * texels, nz * texels, (nx + 1) * texels, (nz + 1) * texels);
+    }
+
+    //! Recursive CDLOD selection; returns false if the node is out of its level's range (so its parent has to cover the area).
+    bool selectNode(int level, int nx, int nz)
+    {
+        if (outsideMap(level, nx, nz))
+            return true; // nothing to draw
+
+        if (!inRange(level, nx, nz, ranges[level]))
+            return false;
+
+        glm::vec3 boxMin, boxMax;
+        nodeBox(level, nx, nz, boxMin, boxMax);
+        if (!frustum->intersectsBox(boxMin, boxMax))
+            return true; // culled, but handled
+
+        if (level == 0 || !inRange(level, nx, nz, ranges[level - 1]))
+        {
+            addArea(level, nx, nz, level);
+            return true;
+        }
+
+        // the node is partly within the finer range: children take over where they can, the rest is covered by quarters of this node at this level
+        for (int c = 0; c < 4; c++)
+        {
+            int cx = nx * 2 + (c & 1), cz = nz * 2 + (c >> 1);
+            if (!selectNode(level - 1, cx, cz))
+                addArea(level - 1, cx, cz, level);
+        }
+
+        return true;
+    }
+
+    //! Adds the area of a node, drawn at the resolution and morph of drawLevel >= level; in streaming mode, areas whose data is not in the window yet are split until the parts are drawable (or too small, leaving a hole until the tiles arrive).
+    void addArea(int level, int nx, int nz, int drawLevel)
+    {
+        if (outsideMap(level, nx, nz))
+            return;
+
+        glm::vec3 boxMin, boxMax;
+        nodeBox(level, nx, nz, boxMin, boxMax);
+        if (!frustum->intersectsBox(boxMin, boxMax))
+            return;
+
+        int b = drawLevel - level;
+        if (isDrawable(level, nx, nz))
+        {
+            float size = nodeSize(level);
+            nodes[b].push_back({nx * size, nz * size, size, (float)drawLevel});
+            return;
+        }
+
+        // the parts keep a grid of at least 2 x 2 cells: the morph slides the odd vertices of the patch, which are only the odd vertices of the draw level's grid if the patch starts on an even one
+        if (level == 0 || b + 1 >= lodGridLevels - 1)
+            return;
+
+        for (int c = 0; c < 4; c++)
+            addArea(level - 1, nx * 2 + (c & 1), nz * 2 + (c >> 1), drawLevel);
+    }
+};
+
+#endif
@@ -0,0 +1,386 @@
+#ifndef TERRAIN_TILES_H
+#define TERRAIN_TILES_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <fcntl.h>    // open
+#include <sys/mman.h> // mmap, madvise
+#include <sys/stat.h> // fstat
+#include <unistd.h>   // close, sysconf
+
+// tiled height map streaming settings
+bool streamTerrain = false;                             // load the height map tile by tile from terrainTilesPath instead of all at once (--stream)
+size_t tileBudgetMB = 64;                               // max size of paged-in tile data in RAM (--tile-budget <MB>)
+const char *const terrainTilesPath = "data/heightmap.tiles";
+const int terrainTileSize = 256;                        // tile side in texels (tile data must be a multiple of the page size)
+const int streamWindowTiles = 8;                        // side of the square window of tiles kept in GPU memory around the camera
+const int tileUploadsPerFrame = 4;                      // max tiles copied into the height texture per frame (bounds the per-frame upload cost)
+const uint32_t tileFileMagic = 0x4C495448;              // "HTIL"
+const uint32_t tileFileVersion = 2;
+
+// on-disk layout: header, per-tile (min, max) height table, padding to the page size, then tiles in row-major order, each tileSize x tileSize 8-bit texels (edge tiles are padded by repeating the border texels)
+struct TileFileHeader
+{
+    uint32_t magic, version;
+    uint32_t width, height; // height map size in texels
+    uint32_t tileSize;      // tile side in texels
+    uint32_t tilesX, tilesZ;
+    uint32_t dataOffset;    // byte offset of the first tile (page-aligned)
+    int64_t sourceSize, sourceTime; // size and modification time (seconds) of the image the file was built from
+};
+
+//! Reads the size and modification time of the source image; returns false if it does not exist.
+bool tileSourceStamp(const char *imagePath, int64_t &size, int64_t &time)
+{
+    struct stat st;
+    if (stat(imagePath, &st) != 0)
+        return false;
+    size = st.st_size;
+    time = st.st_mtime;
+    return true;
+}
+
+//! Returns true if the tile file exists and was built by this version from the current image with the given tile size (otherwise it has to be built again).
+bool tileFileUpToDate(const char *imagePath, const char *tilesPath, int tileSize)
+{
+    TileFileHeader header;
+    FILE *file = fopen(tilesPath, "rb");
+    if (!file)
+        return false;
+    bool read = fread(&header, sizeof(header), 1, file) == 1;
+    fclose(file);
+
+    int64_t size, time;
+    return read && header.magic == tileFileMagic && header.version == tileFileVersion && header.tileSize == (uint32_t)tileSize &&
+           tileSourceStamp(imagePath, size, time) && header.sourceSize == size && header.sourceTime == time;
+}
+
+//! Converts an image into the tiled height map format; returns false if the image cannot be read or the file cannot be written.
+bool buildTileFile(const char *imagePath, const char *tilesPath, int tileSize)
+{
+    int width, height, nrChannels;
+    unsigned char *data = stbi_load(imagePath, &width, &height, &nrChannels, STBI_grey);
+    if (!data)
+        return false;
+
+    TileFileHeader header;
+    header.magic = tileFileMagic;
+    header.version = tileFileVersion;
+    header.width = width;
+    header.height = height;
+    header.tileSize = tileSize;
+    header.tilesX = (width + tileSize - 1) / tileSize;
+    header.tilesZ = (height + tileSize - 1) / tileSize;
+    tileSourceStamp(imagePath, header.sourceSize, header.sourceTime);
+
+    size_t tableBytes = header.tilesX * header.tilesZ * 2;
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    header.dataOffset = (sizeof(TileFileHeader) + tableBytes + pageSize - 1) / pageSize * pageSize;
+
+    std::vector<unsigned char> table(tableBytes);
+    std::vector<unsigned char> tile((size_t)tileSize * tileSize);
+    FILE *file = fopen(tilesPath, "wb");
+    if (!file)
+    {
+        stbi_image_free(data);
+        return false;
+    }
+
+    fseek(file, header.dataOffset, SEEK_SET);
+    for (uint32_t tz = 0; tz < header.tilesZ; tz++)
+    {
+        for (uint32_t tx = 0; tx < header.tilesX; tx++)
+        {
+            unsigned char lo = 255, hi = 0;
+            for (int i = 0; i < tileSize; i++)
+            {
+                for (int j = 0; j < tileSize; j++)
+                {
+                    int z = std::min((int)(tz * tileSize) + i, height - 1);
+                    int x = std::min((int)(tx * tileSize) + j, width - 1);
+                    unsigned char h = data[z * width + x];
+                    tile[i * tileSize + j] = h;
+                    lo = std::min(lo, h);
+                    hi = std::max(hi, h);
+                }
+            }
+
+            table[(tz * header.tilesX + tx) * 2 + 0] = lo;
+            table[(tz * header.tilesX + tx) * 2 + 1] = hi;
+            fwrite(tile.data(), 1, tile.size(), file);
+        }
+    }
+
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(table.data(), 1, table.size(), file);
+    fclose(file);
+    stbi_image_free(data);
+    return true;
+}
+
+// streams a memory-mapped tiled height map around the camera: a background thread pages tiles in (and out, within the RAM budget) ahead of the camera, the render thread copies paged-in tiles into a toroidal window texture
+// (tile (tx, tz) always goes to slot (tx mod W, tz mod W), so with GL_REPEAT the texture can be sampled directly with global texel coordinates)
+class TileStreamer
+{
+public:
+    TileFileHeader header;
+    const unsigned char *minMaxTable; // per tile: min and max texel value
+    unsigned int texture;             // window texture: streamWindowTiles x streamWindowTiles tiles
+    int windowTexels;                 // side of the window texture in texels
+    size_t budgetBytes;
+    bool valid;
+    unsigned long uploadedTiles = 0;  // tiles copied into the window texture so far (changes whenever the streamed heights do)
+
+    TileStreamer(const char *path, size_t budget)
+        : budgetBytes(budget),
+          valid(false),
+          quit(false),
+          cameraTileX(0),
+          cameraTileZ(0),
+          cameraMoved(true),
+          residentBytes(0)
+    {
+        fd = open(path, O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TileFileHeader))
+            return;
+
+        fileSize = st.st_size;
+        mapped = (unsigned char *)mmap(NULL, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED)
+            return;
+
+        memcpy(&header, mapped, sizeof(header));
+        if (header.magic != tileFileMagic || header.version != tileFileVersion)
+            return;
+
+        madvise(mapped, fileSize, MADV_RANDOM); // no kernel read-ahead, paging is driven by the camera
+        minMaxTable = mapped + sizeof(TileFileHeader);
+        tileBytes = (size_t)header.tileSize * header.tileSize;
+        resident.assign(header.tilesX * header.tilesZ, 0);
+        slotTile.assign(streamWindowTiles * streamWindowTiles, -1);
+
+        windowTexels = streamWindowTiles * header.tileSize;
+        glGenTextures(1, &texture);
+        glState.bindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT); // toroidal addressing
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, windowTexels, windowTexels, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+
+        valid = true;
+        worker = std::thread(&TileStreamer::run, this);
+    }
+
+    ~TileStreamer()
+    {
+        if (worker.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                quit = true;
+            }
+            wake.notify_one();
+            worker.join();
+        }
+
+        if (mapped && mapped != MAP_FAILED)
+            munmap(mapped, fileSize);
+        if (fd >= 0)
+            close(fd);
+    }
+
+    //! Render thread, once per frame: tells the worker where the camera is (in texels) and uploads up to tileUploadsPerFrame paged-in tiles that belong to the current window.
+    void update(float cameraTexelX, float cameraTexelZ)
+    {
+        int tx = (int)std::floor(cameraTexelX / header.tileSize);
+        int tz = (int)std::floor(cameraTexelZ / header.tileSize);
+
+        std::vector<int> uploads;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (tx != cameraTileX || tz != cameraTileZ)
+            {
+                cameraTileX = tx;
+                cameraTileZ = tz;
+                cameraMoved = true;
+                wake.notify_one();
+            }
+
+            while (!ready.empty() && (int)uploads.size() < tileUploadsPerFrame)
+            {
+                int tile = ready.front();
+                ready.pop_front();
+
+                int x = tile % header.tilesX, z = tile / header.tilesX;
+                if (inWindow(x, z, tx, tz) && slotTile[slotOf(x, z)] != tile) // skip tiles that the camera left before they arrived, or that are already in place
+                    uploads.push_back(tile);
+            }
+        }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glState.bindTexture(GL_TEXTURE_2D, texture);
+        for (int tile : uploads)
+        {
+            int x = tile % header.tilesX, z = tile / header.tilesX;
+            glTexSubImage2D(GL_TEXTURE_2D, 0, (x % streamWindowTiles) * header.tileSize, (z % streamWindowTiles) * header.tileSize,
+                            header.tileSize, header.tileSize, GL_RED, GL_UNSIGNED_BYTE, tileData(tile)); // pages are already resident, so this does not touch the disk
+            slotTile[slotOf(x, z)] = tile;
+            uploadedTiles++;
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+
+    //! Render thread: returns true if all height map texels of the given inclusive texel rectangle are present in the window texture.
+    bool isAreaUploaded(int x0, int z0, int x1, int z1)
+    {
+        x1 = std::min(x1, (int)header.width - 1);
+        z1 = std::min(z1, (int)header.height - 1);
+
+        for (int tz = z0 / (int)header.tileSize; tz <= z1 / (int)header.tileSize; tz++)
+        {
+            for (int tx = x0 / (int)header.tileSize; tx <= x1 / (int)header.tileSize; tx++)
+            {
+                if (slotTile[slotOf(tx, tz)] != tz * (int)header.tilesX + tx)
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    //! Min and max texel value of a tile (stored in the file header, always available without paging the tile in).
+    glm::vec2 tileMinMax(int tx, int tz)
+    {
+        const unsigned char *mm = minMaxTable + (tz * header.tilesX + tx) * 2;
+        return glm::vec2(mm[0], mm[1]);
+    }
+
+private:
+    int fd = -1;
+    unsigned char *mapped = nullptr;
+    size_t fileSize = 0;
+    size_t tileBytes = 0;
+
+    std::thread worker;
+    std::mutex mutex;              // guards everything below that is shared with the worker
+    std::condition_variable wake;
+    bool quit;
+    int cameraTileX, cameraTileZ;
+    bool cameraMoved;
+    std::deque<int> ready;         // tiles paged in by the worker, waiting for upload
+
+    std::vector<unsigned char> resident; // worker only: 1 if the tile's pages are loaded
+    size_t residentBytes;                // worker only
+    std::vector<int> slotTile;           // render thread only: tile stored in each window slot (-1 if none)
+
+    const unsigned char *tileData(int tile)
+    {
+        return mapped + header.dataOffset + tile * tileBytes;
+    }
+
+    //! Window texture slot of a tile.
+    int slotOf(int tx, int tz)
+    {
+        return (tz % streamWindowTiles) * streamWindowTiles + (tx % streamWindowTiles);
+    }
+
+    //! Returns true if the tile lies in the streamWindowTiles x streamWindowTiles window centered on the camera tile.
+    bool inWindow(int tx, int tz, int cameraX, int cameraZ)
+    {
+        int x0 = cameraX - streamWindowTiles / 2, z0 = cameraZ - streamWindowTiles / 2;
+        return tx >= x0 && tx < x0 + streamWindowTiles && tz >= z0 && tz < z0 + streamWindowTiles;
+    }
+
+    //! Worker thread: whenever the camera enters a new tile, pages in the window around it (nearest tiles first, plus a 1-tile prefetch ring) and evicts the farthest tiles when over budget.
+    void run()
+    {
+        size_t pageSize = sysconf(_SC_PAGESIZE);
+
+        while (true)
+        {
+            int cx, cz;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]
+                          { return quit || cameraMoved; });
+                if (quit)
+                    return;
+                cx = cameraTileX;
+                cz = cameraTileZ;
+                cameraMoved = false;
+            }
+
+            //! Lambda function to measure the tile distance (Chebyshev) from the camera tile.
+            auto distance = [&](int tile)
+            {
+                return std::max(std::abs((int)(tile % header.tilesX) - cx), std::abs((int)(tile / header.tilesX) - cz));
+            };
+
+            // wanted tiles sorted by distance
+            std::vector<int> wanted;
+            int radius = streamWindowTiles / 2 + 1;
+            for (int tz = std::max(cz - radius, 0); tz <= std::min(cz + radius, (int)header.tilesZ - 1); tz++)
+                for (int tx = std::max(cx - radius, 0); tx <= std::min(cx + radius, (int)header.tilesX - 1); tx++)
+                    wanted.push_back(tz * header.tilesX + tx);
+            std::sort(wanted.begin(), wanted.end(), [&](int a, int b)
+                      { return distance(a) < distance(b); });
+
+            for (int tile : wanted)
+            {
+                bool moved;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    moved = cameraMoved || quit;
+                }
+                if (moved)
+                    break; // restart with the new camera position
+
+                if (!resident[tile])
+                {
+                    // make room: evict the farthest resident tiles that are farther than this one
+                    while (residentBytes + tileBytes > budgetBytes)
+                    {
+                        int victim = -1;
+                        for (int t = 0; t < (int)resident.size(); t++)
+                            if (resident[t] && distance(t) > distance(tile) && (victim < 0 || distance(t) > distance(victim)))
+                                victim = t;
+                        if (victim < 0)
+                            break;
+
+                        madvise((void *)tileData(victim), tileBytes, MADV_DONTNEED); // drop the pages, they are re-read from the file if needed again
+                        resident[victim] = 0;
+                        residentBytes -= tileBytes;
+                    }
+                    if (residentBytes + tileBytes > budgetBytes)
+                        break;
+
+                    // page the tile in by touching every page, so that the render thread never waits for the disk
+                    madvise((void *)tileData(tile), tileBytes, MADV_WILLNEED);
+                    volatile unsigned char sink = 0;
+                    for (size_t offset = 0; offset < tileBytes; offset += pageSize)
+                        sink += tileData(tile)[offset];
+
+                    resident[tile] = 1;
+                    residentBytes += tileBytes;
+                }
+
+                if (distance(tile) <= streamWindowTiles / 2)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    ready.push_back(tile); // (re)upload: the window may have been overwritten since the last time
+                }
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of worker threads for data-parallel loops (the calling thread works too, so a pool of size N uses N - 1 extra threads) and for background tasks that overlap the caller's work
+class ThreadPool
+{
+public:
+    ThreadPool(unsigned int threadCount = std::thread::hardware_concurrency())
+    {
+        for (unsigned int i = 1; i < std::max(threadCount, 1u); i++)
+            workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    unsigned int size() const { return workers.size() + 1; }
+
+    //! Calls body(first, last) for consecutive chunks of [begin, end) of at most grain items, spread over all threads, and returns when every chunk is done. Ranges of a single chunk run inline without waking the workers. Not reentrant: call it from one thread at a time.
+    void parallelFor(int begin, int end, int grain, const std::function<void(int, int)> &body)
+    {
+        grain = std::max(grain, 1);
+        if (workers.empty() || end - begin <= grain)
+        {
+            if (begin < end)
+                body(begin, end);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &body;
+            jobEnd = end;
+            jobGrain = grain;
+            nextChunk.store(begin);
+            busyWorkers = workers.size() - runningTasks; // workers busy with a background task skip this job (the others take its chunks)
+            generation++;
+        }
+        wake.notify_all();
+
+        runChunks();
+
+        // every worker checks in once per generation, even if there was no chunk left for it
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&]
+                  { return busyWorkers == 0; });
+        job = nullptr;
+    }
+
+    //! Runs the task on a worker thread and returns its completion, to wait on before using its results (inline without workers). A parallelFor while it runs goes on without that worker.
+    std::future<void> async(std::function<void()> task)
+    {
+        auto packaged = std::make_shared<std::packaged_task<void()>>(std::move(task));
+        std::future<void> result = packaged->get_future();
+        if (workers.empty())
+        {
+            (*packaged)();
+            return result;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back([packaged]
+                            { (*packaged)(); });
+        }
+        wake.notify_one();
+        return result;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    bool stopping = false;
+    unsigned long generation = 0; // incremented for every parallelFor that uses the workers
+    size_t busyWorkers = 0;
+    std::deque<std::function<void()>> tasks; // background tasks not started yet
+    size_t runningTasks = 0;                 // workers running a background task
+
+    // current job (written under the mutex before the workers are woken)
+    const std::function<void(int, int)> *job = nullptr;
+    int jobEnd = 0, jobGrain = 1;
+    std::atomic<int> nextChunk{0};
+
+    //! Claims chunks of the current job until none are left.
+    void runChunks()
+    {
+        for (;;)
+        {
+            int first = nextChunk.fetch_add(jobGrain);
+            if (first >= jobEnd)
+                break;
+
+            (*job)(first, std::min(first + jobGrain, jobEnd));
+        }
+    }
+
+    void workerLoop()
+    {
+        unsigned long seen = 0;
+
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]
+                          { return stopping || generation != seen || !tasks.empty(); });
+                if (stopping)
+                    return;
+
+                // a parallelFor job first: the caller is waiting for it
+                if (generation == seen)
+                {
+                    task = std::move(tasks.front());
+                    tasks.pop_front();
+                    runningTasks++;
+                }
+                seen = generation;
+            }
+
+            if (task)
+            {
+                task();
+
+                std::lock_guard<std::mutex> lock(mutex);
+                runningTasks--;
+                seen = generation; // a job started meanwhile did not count on this worker
+                continue;
+            }
+
+            runChunks();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busyWorkers == 0)
+                done.notify_one();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef UNIFORM_BUFFERS_H
+#define UNIFORM_BUFFERS_H
+
+#include <cstring>
+#include <vector>
+
+// CPU mirrors of the std140 uniform blocks declared in the shaders (only mat4 / vec4 members, so the C++ layout is the std140 layout)
+struct CameraBlock
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 position; // xyz: viewer position (for the light camera: the main camera, which the terrain LOD follows)
+};
+
+struct SceneBlock
+{
+    glm::vec4 lightPos;   // xyz
+    glm::vec4 lightColor; // rgb
+    glm::vec4 fogColor;
+};
+
+struct ShadowsBlock
+{
+    glm::mat4 cascades[maxShadowCascades]; // light view-projection of each cascade, finest first
+    glm::vec4 cascadeCount;                // x: number of cascades in use
+};
+
+// cameras of the passes of a frame, one range each in the camera buffer
+enum CameraPass
+{
+    MAIN_CAMERA,
+    REFLECTED_CAMERA,
+    LIGHT_CAMERA, // first shadow cascade, followed by the others
+    CAMERA_PASS_COUNT = LIGHT_CAMERA + maxShadowCascades
+};
+
+// per-frame camera and shadow data and per-scene light / fog data shared by all programs through uniform buffer objects at fixed binding points (see uniformBlockBindings in shader.h)
+class UniformBuffers
+{
+public:
+    unsigned int cameraUBO, sceneUBO, shadowsUBO;
+
+    UniformBuffers()
+    {
+        // ranges bound with glBindBufferRange must start at a multiple of the offset alignment
+        int alignment = 1;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        cameraStride = (sizeof(CameraBlock) + alignment - 1) / alignment * alignment;
+        cameraData.resize(cameraStride * CAMERA_PASS_COUNT);
+
+        glGenBuffers(1, &cameraUBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, cameraUBO);
+        glBufferData(GL_UNIFORM_BUFFER, cameraData.size(), NULL, GL_DYNAMIC_DRAW);
+
+        glGenBuffers(1, &sceneUBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, sceneUBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(SceneBlock), NULL, GL_STATIC_DRAW);
+
+        glGenBuffers(1, &shadowsUBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, shadowsUBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(ShadowsBlock), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        // the reflected camera stays readable by the water (reflection lookup) during the main pass
+        glBindBufferRange(GL_UNIFORM_BUFFER, REFLECTED_CAMERA_BINDING, cameraUBO, REFLECTED_CAMERA * cameraStride, sizeof(CameraBlock));
+        glBindBufferBase(GL_UNIFORM_BUFFER, SCENE_BINDING, sceneUBO);
+        glBindBufferBase(GL_UNIFORM_BUFFER, SHADOWS_BINDING, shadowsUBO);
+        useCamera(MAIN_CAMERA);
+    }
+
+    //! Uploads the light and fog data (they do not change during the frame).
+    void updateScene(const SceneBlock &scene)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, sceneUBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(SceneBlock), &scene);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    //! Uploads the shadow cascades of the frame.
+    void updateShadows(const ShadowsBlock &shadows)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, shadowsUBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(ShadowsBlock), &shadows);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    //! Uploads the cameras of all passes of the frame with a single buffer update.
+    void updateCameras(const CameraBlock (&cameras)[CAMERA_PASS_COUNT])
+    {
+        for (int pass = 0; pass < CAMERA_PASS_COUNT; pass++)
+            std::memcpy(&cameraData[pass * cameraStride], &cameras[pass], sizeof(CameraBlock));
+
+        glBindBuffer(GL_UNIFORM_BUFFER, cameraUBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, cameraData.size(), cameraData.data());
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    //! Makes the camera of the given pass the one seen by the shaders as the Camera block.
+    void useCamera(CameraPass pass)
+    {
+        glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BINDING, cameraUBO, pass * cameraStride, sizeof(CameraBlock));
+    }
+
+private:
+    size_t cameraStride;           // bytes between the camera ranges
+    std::vector<char> cameraData; // staging copy of the camera buffer
+};
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef WAVE_SOLVER_H
+#define WAVE_SOLVER_H
+
+#include <cmath>
+#include <vector>
+#include "simd.h"
+#include "thread pool.h"
+
+// CPU evaluation of the 2-directional Gerstner waves of the water surface (same formula as shaders/water.vs) for builds / modes without the GPU path; independent of OpenGL
+class WaveSolver
+{
+public:
+    int gridSize;               // cells per side (vertices per side = gridSize + 1)
+    std::vector<float> vertices; // (gridSize + 1)^2 shared grid vertices: position (3), normal (3), texture coordinates (2), model space [-1, 1]
+    bool vectorize = true;       // use the SIMD kernel (false: scalar reference, for comparison)
+
+    WaveSolver(int size, ThreadPool &threads)
+        : gridSize(size),
+          pool(threads)
+    {
+        int n = gridSize + 1;
+        vertices.resize((size_t)n * n * 8);
+
+        // padded to a whole number of SIMD vectors so the row kernel never reads past the end
+        int padded = (n + simd::width - 1) / simd::width * simd::width;
+        columnX.resize(padded), columnY.resize(padded), columnC.resize(padded), columnD.resize(padded);
+    }
+
+    //! Evaluates every grid vertex once, with the analytic normal.
+    void update(float time, float amp, float freq, float speed, float horizontalScale)
+    {
+        /* Both waves are axis-aligned, so the phase of the x-wave depends only on the column and the phase of the z-wave only on the row:
+           P(x, z) = (x + a/s cos(px), a (sin(px) + sin(pz)), z + a/s cos(pz)),  px = f s x - w t,  pz = f s z - w t
+           dP/dx = (1 - a f sin(px), a f s cos(px), 0) = (C, D, 0),  dP/dz = (0, a f s cos(pz), 1 - a f sin(pz)) = (0, A, B)
+           N = dP/dz x dP/dx = (-B D, B C, -A C)
+           So sines and cosines are only needed once per column (here) and once per row (in the row kernel), instead of 5 times per quad corner. */
+        int n = gridSize + 1;
+        float step = 2.0f / gridSize;
+        float k = amp * freq;
+        rowParams = RowParams{amp, k * horizontalScale, k, freq * horizontalScale, speed * time, amp / horizontalScale, step};
+
+        if (vectorize)
+        {
+            for (int j = 0; j < (int)columnX.size(); j += simd::width)
+            {
+                simd::floatv x = simd::fmadd(simd::ramp((float)j), simd::set1(step), simd::set1(-1.0f));
+                simd::floatv phase = simd::sub(simd::mul(simd::set1(rowParams.phaseScale), x), simd::set1(rowParams.phaseOffset));
+                simd::floatv s, c;
+                simd::sincos(phase, s, c);
+
+                simd::store(&columnX[j], simd::fmadd(simd::set1(rowParams.horizontalAmp), c, x));
+                simd::store(&columnY[j], simd::mul(simd::set1(amp), s));
+                simd::store(&columnC[j], simd::fnmadd(simd::set1(k), s, simd::set1(1.0f)));
+                simd::store(&columnD[j], simd::mul(simd::set1(rowParams.slopeScale), c));
+            }
+        }
+        else
+        {
+            for (int j = 0; j < n; j++)
+            {
+                float x = -1.0f + j * step;
+                float phase = rowParams.phaseScale * x - rowParams.phaseOffset;
+                columnX[j] = x + rowParams.horizontalAmp * std::cos(phase);
+                columnY[j] = amp * std::sin(phase);
+                columnC[j] = 1.0f - k * std::sin(phase);
+                columnD[j] = rowParams.slopeScale * std::cos(phase);
+            }
+        }
+
+        // ~16K vertices per task: small grids run on the calling thread only
+        pool.parallelFor(0, n, std::max(1, 16384 / n), [&](int first, int last)
+                         {
+                             for (int i = first; i < last; i++)
+                             {
+                                 if (vectorize)
+                                     solveRowSimd(i);
+                                 else
+                                     solveRowScalar(i, 0);
+                             } });
+    }
+
+private:
+    ThreadPool &pool;
+    std::vector<float> columnX, columnY, columnC, columnD; // per-column terms: displaced x, x-wave height, C and D (see update)
+
+    // wave constants of the current update, shared by all rows
+    struct RowParams
+    {
+        float amp, slopeScale, k, phaseScale, phaseOffset, horizontalAmp, step; // a, a f s, a f, f s, w t, a / s, grid step
+    } rowParams;
+
+    //! Row terms: displaced z, z-wave height, A and B (see update).
+    void rowTerms(int i, float &z, float &y, float &a, float &b) const
+    {
+        float z0 = -1.0f + i * rowParams.step;
+        float phase = rowParams.phaseScale * z0 - rowParams.phaseOffset;
+        float s = std::sin(phase), c = std::cos(phase);
+
+        z = z0 + rowParams.horizontalAmp * c;
+        y = rowParams.amp * s;
+        a = rowParams.slopeScale * c;
+        b = 1.0f - rowParams.k * s;
+    }
+
+    //! Writes vertices [firstColumn, gridSize] of row i.
+    void solveRowScalar(int i, int firstColumn)
+    {
+        float z, y, a, b;
+        rowTerms(i, z, y, a, b);
+        float *out = &vertices[((size_t)i * (gridSize + 1) + firstColumn) * 8];
+
+        for (int j = firstColumn; j <= gridSize; j++, out += 8)
+        {
+            float nx = -b * columnD[j], ny = b * columnC[j], nz = -a * columnC[j];
+            float invLength = 1.0f / std::sqrt(nx * nx + ny * ny + nz * nz);
+
+            out[0] = columnX[j];
+            out[1] = columnY[j] + y;
+            out[2] = z;
+            out[3] = nx * invLength;
+            out[4] = ny * invLength;
+            out[5] = nz * invLength;
+
+            // integer texture coordinates tile the water texture once per cell (GL_REPEAT)
+            out[6] = (float)j;
+            out[7] = (float)i;
+        }
+    }
+
+    //! Same as solveRowScalar, simd::width vertices at a time; the remainder of the row goes through the scalar version.
+    void solveRowSimd(int i)
+    {
+        float z, y, a, b;
+        rowTerms(i, z, y, a, b);
+        float *out = &vertices[(size_t)i * (gridSize + 1) * 8];
+
+        simd::floatv rowZ = simd::set1(z), rowY = simd::set1(y), rowA = simd::set1(a), rowB = simd::set1(b), rowV = simd::set1((float)i);
+
+        int j = 0;
+        for (; j + simd::width <= gridSize + 1; j += simd::width, out += 8 * simd::width)
+        {
+            simd::floatv c = simd::load(&columnC[j]), d = simd::load(&columnD[j]);
+            simd::floatv nx = simd::mul(rowB, d), ny = simd::mul(rowB, c), nz = simd::mul(rowA, c); // nx and nz without the sign (fixed below)
+            simd::floatv invLength = simd::rsqrt(simd::fmadd(nx, nx, simd::fmadd(ny, ny, simd::mul(nz, nz))));
+            simd::floatv sign = simd::set1(-0.0f);
+
+            simd::floatv components[8] = {
+                simd::load(&columnX[j]),
+                simd::add(simd::load(&columnY[j]), rowY),
+                rowZ,
+                simd::bitXor(simd::mul(nx, invLength), sign),
+                simd::mul(ny, invLength),
+                simd::bitXor(simd::mul(nz, invLength), sign),
+                simd::ramp((float)j),
+                rowV};
+            simd::storeInterleaved8(out, components);
+        }
+
+        if (j <= gridSize)
+            solveRowScalar(i, j);
+    }
+};
+
+#endif
@@ -1,7 +1,9 @@
 #ifndef PARTICLE_H
 #define PARTICLE_H
 
-#include <ctime>
+#include "radix sort.h"
+#include "random.h"
+#include "thread pool.h"
 
 // fog effect settings (effects applied to other entities)
 const float waterFogStart = 20.0f;  // ..
@@ -14,51 +16,96 @@ const float particleSize = 1000.0f;
 const int maxAlive = 2000;     // max number of particles allowed to be alive simultaneously
 const float fogRadius = 20.0f; // radius around camera for spawning
 const glm::vec4 fogColor = glm::vec4(0.8, 0.8, 0.85, 0.5);
-
-// particle definition
-struct FogParticle
+const int fogDownsample = 2;    // the soft fog layer has 1 / fogDownsample of the screen resolution per axis
+const float fogSoftness = 1.0f; // view depth distance over which particles fade out in front of the scene
+bool softFog = true;            // render the fog sorted and soft into a reduced-resolution layer composited over the scene (key P), otherwise directly at full resolution
+bool reportFogCost = false;     // print the GPU time and shaded fragments of the fog every fogReportFrames frames (--fog-stats)
+const int fogReportFrames = 300;
+const uint64_t fogRandomStream = (1ull << 32) + 1; // random stream of the fog emitter (distinct from the rain streams)
+
+// fog particles packed at the front of the arrays: [0, count) are alive, [count, capacity) are free slots. Spawning takes the first free slot and a dying particle is replaced by the last live one (swap-remove), so both are O(1), updates only touch live particles and the positions upload as one contiguous range
+struct FogParticles
 {
-    glm::vec3 Position;
-    glm::vec3 Velocity;
-    float Life;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> velocities;
+    std::vector<float> life;
+    int count = 0;
+
+    FogParticles(int capacity)
+        : positions(capacity),
+          velocities(capacity),
+          life(capacity)
+    {
+    }
+
+    //! Returns the slot for a new particle: the first free one, or slot 0 if all are alive (the particle there is replaced).
+    int spawn()
+    {
+        return count < (int)life.size() ? count++ : 0;
+    }
+
+    //! Removes particle i by moving the last live particle into its slot.
+    void kill(int i)
+    {
+        count--;
+        positions[i] = positions[count];
+        velocities[i] = velocities[count];
+        life[i] = life[count];
+    }
 };
 
 class Fog
 {
 public:
     Shader shader;
+    Shader compositeShader;
     Camera &camera;
     float spawnTimer;
     unsigned int VAO, VBO;
     unsigned int texture;
-    std::vector<FogParticle> particles;
+    FogParticles particles;
     float groundLevel;
 
-    Fog(Camera &cam, float waterLevel)
+    Fog(Camera &cam, float waterLevel, ThreadPool &threads)
         : camera(cam),
           shader("shaders/fog.vs", "shaders/fog.fs"),
+          compositeShader("shaders/fog composite.vs", "shaders/fog composite.fs"),
           spawnTimer(0.0f),
-          groundLevel(waterLevel)
+          particles(maxAlive),
+          groundLevel(waterLevel),
+          pool(threads)
     {
-        particles.resize(maxAlive);
+        sortedPositions.resize(maxAlive);
 
         shader.use();
-        shader.setVec4("fogColor", fogColor);
+        shader.setInt("sceneDepth", 1);
+        shader.setFloat("softness", fogSoftness);
+        uniforms.soft = shader.uniform<bool>("soft");
+        uniforms.pointSize = shader.uniform<float>("pointSize");
+
+        // sprite size in screen pixels, as large as the driver allows
+        float pointSizeRange[2];
+        glGetFloatv(GL_POINT_SIZE_RANGE, pointSizeRange);
+        pointSize = std::min(particleSize, pointSizeRange[1]);
+        glEnable(GL_PROGRAM_POINT_SIZE);
 
         // setup buffers
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
 
-        glBindVertexArray(VAO);
+        glState.bindVertexArray(VAO);
 
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, maxAlive * sizeof(glm::vec3), NULL, GL_DYNAMIC_DRAW); // room for all particles, filled up to the live count every frame
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *)0);
         glVertexAttribDivisor(0, 1);
         glEnableVertexAttribArray(0);
 
+        glGenVertexArrays(1, &compositeVAO); // the composite triangle has no vertex data, but core profile needs a VAO to draw
+
         // setup texture
         glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        glState.bindTexture(GL_TEXTURE_2D, texture);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -71,88 +118,258 @@ public:
         glGenerateMipmap(GL_TEXTURE_2D);
         stbi_image_free(data);
 
-        std::srand((unsigned)std::time(NULL));
+        // setup the reduced-resolution fog layer (color) and the copy of the scene depth it is faded against (textures are sized in draw)
+        glGenTextures(1, &layerTexture);
+        glState.bindTexture(GL_TEXTURE_2D, layerTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // bilinear upsampling in the composite
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        glGenTextures(1, &depthTexture);
+        glState.bindTexture(GL_TEXTURE_2D, depthTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glGenFramebuffers(1, &layerFBO);
+        glGenFramebuffers(1, &depthFBO);
+
+        glGenQueries(2, timeQueries);
+        glGenQueries(2, sampleQueries);
+
     }
 
-    //! Core function: spawns, kills and updates all particles.
-    void draw(float dt, glm::mat4 view, glm::mat4 projection)
+    ~Fog()
     {
-        shader.use();
-        shader.setMat4("view", view);
-        shader.setMat4("projection", projection);
+        if (sortTask.valid())
+            sortTask.wait(); // the sort reads and writes the particle arrays
+    }
 
-        std::vector<glm::vec3> positions;
+    //! Spawns, kills and updates all particles, then starts sorting them back to front on a worker thread (collected by draw, so the sort overlaps the rendering of the scene).
+    void update(float dt)
+    {
+        if (sortTask.valid())
+            sortTask.wait(); // a previous sort that was not drawn still reads the particles
 
         // spawn a new particle
         spawnTimer += dt;
         if (spawnTimer >= spawnRate)
         {
-            int firstDead = firstUnusedParticle();
-            respawnParticle(particles[firstDead]); // reuse a slot in the vector instead of continuously appending new particles to the end
+            respawnParticle(particles.spawn());
             spawnTimer = 0.0f;
         }
 
-        // update all particles
-        for (int i = 0; i < maxAlive; i++)
+        // update live particles (a particle that died takes the last live one into its slot, which is then updated in its place)
+        for (int i = 0; i < particles.count;)
         {
-            FogParticle &p = particles[i];
-
-            if (p.Life > 0.0f)
+            if (particles.life[i] <= 0.0f)
             {
-                p.Life -= dt;
-                p.Position += p.Velocity * dt;
-
-                positions.push_back(p.Position);
+                particles.kill(i);
+                continue;
             }
+
+            particles.life[i] -= dt;
+            particles.positions[i] += particles.velocities[i] * dt;
+            i++;
         }
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        glm::vec3 position = camera.Position, front = camera.Front;
+        sortTask = pool.async([this, position, front]
+                              { sortBackToFront(position, front); });
+    }
+
+    //! Queues the fog in the transparent layer of the main pass (the particles surround the camera: depth 0, the nearest transparent draw).
+    void submit(RenderQueue &queue)
+    {
+        queue.submit(MAIN_PASS, TRANSPARENT_LAYER, shader.shaderProgram, texture, 0.0f, [this]
+                     { draw(); });
+    }
+
+    //! Renders the particles sorted by update: soft and at reduced resolution into the fog layer, then composited over the current framebuffer (softFog), or directly.
+    void draw()
+    {
+        if (!sortTask.valid())
+            return;
+        sortTask.get();
 
         // upload positions to buffer
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, particles.count * sizeof(glm::vec3), sortedPositions.data());
 
-        glDepthMask(GL_FALSE);
+        if (reportFogCost)
+        {
+            glBeginQuery(GL_TIME_ELAPSED, timeQueries[costFrame % 2]);
+            glBeginQuery(GL_SAMPLES_PASSED, sampleQueries[costFrame % 2]);
+        }
 
-        // render all particles
-        glPointSize(particleSize);
-        glBindVertexArray(VAO);
-        glDrawArraysInstanced(GL_POINTS, 0, 1, positions.size());
-        glBindVertexArray(0);
+        glState.bindTexture(0, GL_TEXTURE_2D, texture);
+
+        if (softFog)
+            drawSoft();
+        else
+        {
+            shader.use();
+            uniforms.soft.set(false);
+            uniforms.pointSize.set(pointSize);
 
-        glDepthMask(GL_TRUE);
+            glState.depthMask(false);
+            drawParticles();
+            glState.depthMask(true);
+        }
+
+        if (reportFogCost)
+        {
+            glEndQuery(GL_TIME_ELAPSED);
+            glEndQuery(GL_SAMPLES_PASSED);
+            collectCost();
+        }
     }
 
 private:
-    //! Returns the index of the first dead particle found.
-    int firstUnusedParticle()
+    struct
     {
-        for (int i = 0; i < maxAlive; i++)
+        UniformHandle<bool> soft;
+        UniformHandle<float> pointSize;
+    } uniforms;
+    float pointSize;
+    Random random{randomSeed, fogRandomStream};
+
+    // back-to-front order, computed on a worker thread of the pool between update and draw
+    ThreadPool &pool;
+    std::future<void> sortTask;
+    std::vector<uint32_t> sortKeys, sortOrder, tempKeys, tempOrder;
+    std::vector<glm::vec3> sortedPositions; // positions of the live particles, farthest first (the uploaded array)
+
+    // reduced-resolution fog layer
+    unsigned int layerFBO, layerTexture, depthFBO, depthTexture, compositeVAO;
+    int layerWidth = 0, layerHeight = 0;
+
+    // fill-rate report: queries of the current and of the previous frame (read a frame late, so the CPU does not wait for the GPU)
+    unsigned int timeQueries[2], sampleQueries[2];
+    int costFrame = 0;
+    double costMs = 0.0, costFragments = 0.0;
+
+    //! Orders the live particles by decreasing view depth (radix sort of the depths as integer keys) and gathers their positions into sortedPositions.
+    void sortBackToFront(glm::vec3 eye, glm::vec3 front)
+    {
+        int n = particles.count;
+        sortKeys.resize(n);
+        sortOrder.resize(n);
+
+        for (int i = 0; i < n; i++)
         {
-            if (particles[i].Life <= 0.0f)
-                return i;
+            sortKeys[i] = ~floatSortKey(glm::dot(particles.positions[i] - eye, front)); // inverted: ascending keys = decreasing depth
+            sortOrder[i] = i;
         }
 
-        return 0;
+        radixSort(sortKeys, sortOrder, tempKeys, tempOrder);
+
+        for (int i = 0; i < n; i++)
+            sortedPositions[i] = particles.positions[sortOrder[i]];
+    }
+
+    void drawParticles()
+    {
+        glState.bindVertexArray(VAO);
+        glDrawArraysInstanced(GL_POINTS, 0, 1, particles.count);
+    }
+
+    //! Soft particles at reduced resolution: scene depth copied down to the layer size, particles blended back to front (premultiplied alpha) and faded where they approach the scene, then the layer is upsampled over the framebuffer.
+    void drawSoft()
+    {
+        int viewport[4];
+        std::copy(glState.currentViewport(), glState.currentViewport() + 4, viewport); // the framebuffer and viewport to composite into (from the state cache: no round trip to the driver)
+        unsigned int target = glState.drawFramebuffer();
+        resizeLayer(std::max(1, viewport[2] / fogDownsample), std::max(1, viewport[3] / fogDownsample));
+
+        // scene depth at the layer resolution (depth blits need matching formats and nearest filtering)
+        glState.bindFramebuffer(GL_READ_FRAMEBUFFER, target);
+        glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFBO);
+        glBlitFramebuffer(viewport[0], viewport[1], viewport[0] + viewport[2], viewport[1] + viewport[3], 0, 0, layerWidth, layerHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+        // particles into the layer; occlusion comes from the fade, so there is no depth test
+        const float transparent[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        glState.bindFramebuffer(GL_FRAMEBUFFER, layerFBO);
+        glState.viewport(0, 0, layerWidth, layerHeight);
+        glClearBufferfv(GL_COLOR, 0, transparent);
+
+        shader.use();
+        uniforms.soft.set(true);
+        uniforms.pointSize.set(pointSize / fogDownsample);
+        glState.bindTexture(1, GL_TEXTURE_2D, depthTexture);
+
+        glState.blendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        drawParticles();
+
+        // composite over the scene
+        glState.bindFramebuffer(GL_FRAMEBUFFER, target);
+        glState.viewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+        compositeShader.use();
+        glState.bindTexture(0, GL_TEXTURE_2D, layerTexture);
+
+        glState.setEnabled(GL_DEPTH_TEST, false);
+        glState.bindVertexArray(compositeVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glState.setEnabled(GL_DEPTH_TEST, true);
+
+        glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
+
+    //! (Re)allocates the layer textures when the viewport size changes.
+    void resizeLayer(int width, int height)
+    {
+        if (width == layerWidth && height == layerHeight)
+            return;
+        layerWidth = width, layerHeight = height;
+
+        glState.bindTexture(GL_TEXTURE_2D, layerTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glState.bindFramebuffer(GL_FRAMEBUFFER, layerFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, layerTexture, 0);
+
+        // same format as the default framebuffer depth (24-bit depth + 8-bit stencil), as required by the depth blit
+        glState.bindTexture(GL_TEXTURE_2D, depthTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+        glState.bindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    }
+
+    //! Adds the previous frame's GPU time and fragment count to the averages and prints them every fogReportFrames frames.
+    void collectCost()
+    {
+        if (costFrame > 0)
+        {
+            GLuint64 nanoseconds = 0, samples = 0;
+            glGetQueryObjectui64v(timeQueries[(costFrame - 1) % 2], GL_QUERY_RESULT, &nanoseconds);
+            glGetQueryObjectui64v(sampleQueries[(costFrame - 1) % 2], GL_QUERY_RESULT, &samples);
+            costMs += nanoseconds * 1e-6;
+            costFragments += samples;
+        }
+
+        if (++costFrame % fogReportFrames == 0)
+        {
+            int frames = fogReportFrames - 1; // the first frame of a report has no previous frame to read
+            std::cout << "Fog (" << (softFog ? "soft, 1/" + std::to_string(fogDownsample) + " resolution" : "direct, full resolution") << ", " << particles.count << " particles): "
+                      << costMs / frames << " ms GPU, " << (long)(costFragments / frames) << " fragments per frame" << std::endl;
+            costMs = costFragments = 0.0;
+            costFrame = 0;
+        }
     }
 
-    //! Updates the dead particle as a new respawned particle.
-    void respawnParticle(FogParticle &p)
+    //! Updates the particle in slot i as a new respawned particle.
+    void respawnParticle(int i)
     {
-        float randomAngle = (std::rand() / (float)RAND_MAX) * 2.0f * glm::pi<float>(); // random in range [0, 2π] (in radians)
-        float randomRadius = std::sqrt(std::rand() / (float)RAND_MAX) * fogRadius;     // random in range [0, fogRadius] with bias toward center via sqrt
+        float randomAngle = random.uniform(0.0f, 2.0f * glm::pi<float>()); // random in range [0, 2π] (in radians)
+        float randomRadius = std::sqrt(random.uniform()) * fogRadius;       // random in range [0, fogRadius] with bias toward center via sqrt
         float x = camera.Position.x + randomRadius * cos(randomAngle);
         float z = camera.Position.z + randomRadius * sin(randomAngle);
 
-        p.Position = glm::vec3(x, groundLevel + 1.0f, z);
+        particles.positions[i] = glm::vec3(x, groundLevel + 1.0f, z);
 
-        p.Velocity = glm::vec3(
-            ((std::rand() / (float)RAND_MAX) - 0.5f) * 2.0f,
-            0.0f,
-            ((std::rand() / (float)RAND_MAX) - 0.5f) * 2.0f); // slight random drift in horizontal direction
+        particles.velocities[i] = glm::vec3(random.uniform(-1.0f, 1.0f), 0.0f, random.uniform(-1.0f, 1.0f)); // slight random drift in horizontal direction
 
-        p.Life = 20.0f;
+        particles.life[i] = 20.0f;
     }
 };
 
@@ -1,41 +1,39 @@
 #ifndef RAIN_H
 #define RAIN_H
 
-#include <ctime>
+#include "rain particles.h"
 
 // rain emitter settings
-const int numDrops = 10000;                                                   // number of raindrops
+int numDrops = 10000;                                                         // number of raindrops (--rain-drops <count>)
 const float spawnHeight = 10.0f;                                              // min height at which raindrops spawn
 const float rainRadius = 20.0f;                                               // radius around camera for spawning
 const float rainSpeed = 4.0f;                                                 // raindrop fall speed
 const glm::vec3 windDirection = glm::normalize(glm::vec3(1.0f, -4.0f, 0.3f)); // raindrop fall angle (angled to the right and a bit forward)
 const glm::vec4 rainColor = glm::vec4(0.5, 0.6, 0.9, 1.0);                    // raindrop color
-
-// particle definition
-struct RainParticle
-{
-    glm::vec3 Position;
-    glm::vec3 Velocity;
-};
+const int rainBufferRegions = 3;                                              // frames of drop positions in flight in the persistently mapped buffer
+const uint64_t gpuRainRandomStream = 1ull << 32;                              // random stream of the GPU rain seed (beyond the chunk streams of RainParticles)
+bool gpuRain = false;                                                         // simulate the drops on the GPU with transform feedback instead of on the CPU (key R, --gpu-rain)
 
 class Rain
 {
 public:
     Shader shader;
+    Shader updateShader; // GPU simulation step (transform feedback)
     Camera &camera;
     unsigned int VAO, VBO;
     unsigned int texture;
-    std::vector<RainParticle> particles;
+    RainParticles particles;
     float groundLevel;
+    bool persistentBuffer; // positions are written straight into a persistently mapped buffer (ARB_buffer_storage), otherwise into a freshly mapped one every frame
 
     // constructor that sets up the initial emitter configuration
-    Rain(Camera &cam, float waterLevel)
+    Rain(Camera &cam, float waterLevel, ThreadPool &threadPool)
         : camera(cam),
           shader("shaders/rain.vs", "shaders/rain.fs"),
+          updateShader("shaders/rain update.vs", NULL, {"outPosition"}),
+          particles(numDrops, windDirection * rainSpeed, spawnHeight, rainRadius, threadPool),
           groundLevel(waterLevel)
     {
-        particles.resize(numDrops);
-
         shader.use();
         shader.setVec4("rainColor", rainColor);
         shader.setFloat("spawnHeight", spawnHeight);
@@ -44,18 +42,67 @@ public:
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
 
-        glBindVertexArray(VAO);
+        glState.bindVertexArray(VAO);
 
+        // positions as 3 float attributes (x, y, z arrays of the particle store), set in draw as their offset moves
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *)0);
-        glVertexAttribDivisor(0, 1); // needed for instance rendering: to update the attribute at location 0 once per instance
-        glEnableVertexAttribArray(0);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            glVertexAttribDivisor(axis, 1); // needed for instance rendering: to update the attribute once per instance
+            glEnableVertexAttribArray(axis);
+        }
+
+        // one region per frame in flight, each guarded by a fence, so the CPU never writes positions the GPU is still reading
+        regionBytes = 3 * particles.capacity * sizeof(float);
+        persistentBuffer = GLAD_GL_ARB_buffer_storage;
+        if (persistentBuffer)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_ARRAY_BUFFER, rainBufferRegions * regionBytes, NULL, flags);
+            mappedBuffer = (char *)glMapBufferRange(GL_ARRAY_BUFFER, 0, rainBufferRegions * regionBytes, flags);
+        }
+        else
+            glBufferData(GL_ARRAY_BUFFER, regionBytes, NULL, GL_STREAM_DRAW);
+
+        // GPU simulation: positions ping-pong between 2 buffers, read as vertices by the update pass and as instances by the draw
+        std::vector<float> origin(3 * numDrops, 0.0f); // all drops start at the origin and respawn around the viewer on the first update
+        glGenBuffers(2, feedbackBuffers);
+        glGenVertexArrays(2, updateVAO);
+        glGenVertexArrays(2, drawVAO);
+
+        for (int i = 0; i < 2; i++)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, feedbackBuffers[i]);
+            glBufferData(GL_ARRAY_BUFFER, origin.size() * sizeof(float), origin.data(), GL_DYNAMIC_COPY);
+
+            glState.bindVertexArray(updateVAO[i]);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+            glEnableVertexAttribArray(0);
+
+            glState.bindVertexArray(drawVAO[i]);
+            for (int axis = 0; axis < 3; axis++)
+            {
+                glVertexAttribPointer(axis, 1, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)(axis * sizeof(float)));
+                glVertexAttribDivisor(axis, 1);
+                glEnableVertexAttribArray(axis);
+            }
+        }
+        glState.bindVertexArray(0);
+
+        updateShader.use();
+        updateShader.setVec3("velocity", windDirection * rainSpeed);
+        updateShader.setFloat("minY", groundLevel + 1.0f);
+        updateShader.setFloat("spawnHeight", spawnHeight);
+        updateShader.setFloat("spawnRadius", rainRadius);
+        updateUniforms.dt = updateShader.uniform<float>("dt");
+        updateUniforms.center = updateShader.uniform<glm::vec3>("center");
+        updateUniforms.seed = updateShader.uniform<unsigned int>("seed");
 
         glEnable(GL_PROGRAM_POINT_SIZE); // allow vertex shader to control point size
 
         // setup texture
         glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        glState.bindTexture(GL_TEXTURE_2D, texture);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -68,63 +115,110 @@ public:
         glGenerateMipmap(GL_TEXTURE_2D);
         stbi_image_free(data);
 
-        std::srand(std::time(NULL)); // seed the random number generator to produce different results on each program launch
+        gpuSeed = Random(randomSeed, gpuRainRandomStream).next();
+    }
+
+    //! Queues the rain in the transparent layer of the main pass (the drops fall around the camera: depth 0, like the fog, and drawn after it).
+    void submit(RenderQueue &queue, float dt)
+    {
+        queue.submit(MAIN_PASS, TRANSPARENT_LAYER, shader.shaderProgram, texture, 0.0f, [this, dt]
+                     { draw(dt); });
     }
 
     //! Core function: spawns, kills and updates all particles.
-    void draw(float dt, const glm::mat4 &view, const glm::mat4 &projection)
+    void draw(float dt)
     {
+        unsigned int vao = gpuRain ? simulateOnGPU(dt) : simulateOnCPU(dt);
+
         shader.use();
-        shader.setMat4("view", view);
-        shader.setMat4("projection", projection);
-        shader.setVec3("cameraPos", camera.Position);
 
-        std::vector<glm::vec3> positions;
+        glState.bindTexture(0, GL_TEXTURE_2D, texture);
 
-        // update all particles
-        for (int i = 0; i < numDrops; i++)
-        {
-            RainParticle &p = particles[i];
+        glState.depthMask(false); // disable writing to the depth buffer while rendering particles, preventing them from overlaying each other
 
-            p.Position += p.Velocity * dt;
+        // render all particles
+        glState.bindVertexArray(vao);
+        glDrawArraysInstanced(GL_POINTS, 0, 1, numDrops); // instance rendering: draws many objects with one function call, using different attributes per instance (more efficient than a for loop)
 
-            // respawn particle if reached ground
-            if (p.Position.y <= groundLevel + 1.0f)
-                respawnParticle(p);
+        glState.depthMask(true); // re-enable for the rest of the scene
 
-            positions.push_back(p.Position);
+        if (!gpuRain && persistentBuffer)
+        {
+            fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            region = (region + 1) % rainBufferRegions;
         }
+    }
+
+private:
+    size_t regionBytes;                      // size of the positions of one frame
+    char *mappedBuffer = nullptr;            // persistent mapping of VBO
+    GLsync fences[rainBufferRegions] = {};   // signaled when the GPU has drawn from the region
+    int region = 0;                          // region written this frame
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture);
+    unsigned int feedbackBuffers[2], updateVAO[2], drawVAO[2]; // GPU simulation state: positions of the previous and of the current frame
+    int current = 0;                                           // feedback buffer holding the latest positions
+    unsigned int gpuSeed, frame = 0;                           // random seed of the GPU respawn: per launch, then per frame
 
-        // upload positions to buffer
+    struct
+    {
+        UniformHandle<float> dt;
+        UniformHandle<glm::vec3> center;
+        UniformHandle<unsigned int> seed;
+    } updateUniforms;
+
+    //! Advances the particle store on the CPU, writing the positions straight into the vertex buffer; returns the VAO to draw them with.
+    unsigned int simulateOnCPU(float dt)
+    {
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_DYNAMIC_DRAW);
 
-        glDepthMask(GL_FALSE); // disable writing to the depth buffer while rendering particles, preventing them from overlaying each other
+        // update all particles (drops respawn when they reach the ground)
+        size_t offset = 0;
+        if (persistentBuffer)
+        {
+            if (fences[region])
+            {
+                glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000); // wait (at most 1 s) until the GPU is done with the positions written 3 frames ago
+                glDeleteSync(fences[region]);
+            }
+            offset = region * regionBytes;
+            particles.update(dt, groundLevel + 1.0f, camera.Position, (float *)(mappedBuffer + offset));
+        }
+        else
+        {
+            float *positions = (float *)glMapBufferRange(GL_ARRAY_BUFFER, 0, regionBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT); // invalidation gives new storage instead of waiting for the GPU
+            particles.update(dt, groundLevel + 1.0f, camera.Position, positions);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
 
-        // render all particles
-        glBindVertexArray(VAO);
-        glDrawArraysInstanced(GL_POINTS, 0, 1, positions.size()); // instance rendering: draws many objects with one function call, using different attributes per instance (more efficient than a for loop)
-        glBindVertexArray(0);
+        glState.bindVertexArray(VAO);
+        for (int axis = 0; axis < 3; axis++)
+            glVertexAttribPointer(axis, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void *)(offset + axis * particles.capacity * sizeof(float)));
 
-        glDepthMask(GL_TRUE); // re-enable for the rest of the scene
+        return VAO;
     }
 
-private:
-    //! Updates the dead particle as a new respawned particle.
-    void respawnParticle(RainParticle &p)
+    //! Advances the drops on the GPU: the update shader reads the current buffer as points and transform feedback captures the new positions into the other one, with rasterization off. Nothing is read back or uploaded.
+    unsigned int simulateOnGPU(float dt)
     {
-        float randomOffset = static_cast<float>(std::rand()) / (static_cast<float>(RAND_MAX / 10.0f)); // random in range [0, 10]
-        float randomAngle = (std::rand() / (float)RAND_MAX) * 2.0f * glm::pi<float>();                 // random in range [0, 2π] (in radians)
-        float randomRadius = std::sqrt(std::rand() / (float)RAND_MAX) * rainRadius;                    // random in range [0, rainRadius] with bias toward center via sqrt
-        float x = camera.Position.x + randomRadius * cos(randomAngle);
-        float z = camera.Position.z + randomRadius * sin(randomAngle);
-        float y = spawnHeight + randomOffset;
-
-        p.Position = glm::vec3(x, y, z);
-        p.Velocity = windDirection * rainSpeed;
+        updateShader.use();
+        updateUniforms.dt.set(dt);
+        updateUniforms.center.set(camera.Position);
+        updateUniforms.seed.set(gpuSeed + frame++);
+
+        int next = 1 - current;
+        glState.setEnabled(GL_RASTERIZER_DISCARD, true);
+        glState.bindVertexArray(updateVAO[current]);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, feedbackBuffers[next]);
+
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, numDrops);
+        glEndTransformFeedback();
+
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glState.setEnabled(GL_RASTERIZER_DISCARD, false);
+
+        current = next;
+        return drawVAO[current];
     }
 };
 